@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "harness.h"
+#include "ecs/ECS.h"
+#include "geometry/hittable.h"
+#include "material/material.h"
+
+namespace {
+
+    constexpr uint64_t SEED = 3;
+    // Entities per fresh ECS in the batched benchmarks
+    constexpr Entity BATCH = 1 << 16;
+
+    struct BenchSystem : System {};
+
+    // ECS laid out like main.cpp's: Sphere + Material grouped, one system over both
+    std::unique_ptr<ECS> make_ecs() {
+        auto ecs = std::make_unique<ECS>();
+        ecs->registerComponent<render::Sphere>();
+        ecs->registerComponent<render::Material>();
+        ecs->registerGroup<render::Sphere, render::Material>();
+        ecs->registerSystem<BenchSystem>();
+        ecs->setSystemSignature<BenchSystem>(ecs->componentSignature<render::Sphere, render::Material>());
+        return ecs;
+    }
+
+    std::vector<Entity> populate(ECS& ecs, Entity count) {
+        std::vector<Entity> entities(count);
+        for (Entity i = 0; i < count; ++i) {
+            entities[i] = ecs.createEntity();
+            ecs.addComponent(entities[i], render::Sphere{ point3(real(i), 0., 0.), 1. });
+            ecs.addComponent(entities[i], render::Material{ {0.5, 0.5, 0.5}, 0., 0. });
+        }
+        return entities;
+    }
+
+    // Fixed pseudo-random visiting order over [0, count)
+    std::vector<Entity> shuffled(Entity count) {
+        std::vector<Entity> order(count);
+        RNG rng(SEED);
+        for (Entity i = 0; i < count; ++i) {
+            order[i] = i;
+        }
+        for (Entity i = count - 1; i > 0; --i) {
+            std::swap(order[i], order[rng.next_u64() % (uint64_t(i) + 1)]);
+        }
+        return order;
+    }
+
+    BENCHMARK("ecs/addComponent", "components", [](bench::State& state) {
+        for (uint64_t done = 0; done < state.iterations; done += BATCH) {
+            const Entity count = Entity(std::min<uint64_t>(BATCH, state.iterations - done));
+            state.pause();
+            auto ecs = make_ecs();
+            std::vector<Entity> entities(count);
+            for (Entity i = 0; i < count; ++i) {
+                entities[i] = ecs->createEntity();
+            }
+            state.resume();
+            for (Entity i = 0; i < count; ++i) {
+                ecs->addComponent(entities[i], render::Sphere{ point3(real(i), 0., 0.), 1. });
+            }
+            state.pause();
+            ecs.reset();
+            state.resume();
+        }
+        state.items = state.iterations;
+        });
+
+    // Same components added a batch at a time to fresh entities, as a scene file loads them
+    BENCHMARK("ecs/addComponents", "components", [](bench::State& state) {
+        state.pause();
+        std::vector<render::Sphere> spheres(BATCH);
+        for (Entity i = 0; i < BATCH; ++i) {
+            spheres[i] = render::Sphere{ point3(real(i), 0., 0.), 1. };
+        }
+        state.resume();
+        for (uint64_t done = 0; done < state.iterations; done += BATCH) {
+            const Entity count = Entity(std::min<uint64_t>(BATCH, state.iterations - done));
+            state.pause();
+            auto ecs = make_ecs();
+            const Entity first = ecs->createEntities(count);
+            state.resume();
+            ecs->addComponents(first, count, spheres.data());
+            state.pause();
+            ecs.reset();
+            state.resume();
+        }
+        state.items = state.iterations;
+        });
+
+    BENCHMARK("ecs/getComponent", "lookups", [](bench::State& state) {
+        state.pause();
+        auto ecs = make_ecs();
+        const std::vector<Entity> entities = populate(*ecs, BATCH);
+        const std::vector<Entity> order = shuffled(BATCH);
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            bench::keep(ecs->getComponent<render::Sphere>(entities[order[i % BATCH]]).radius);
+        }
+        state.items = state.iterations;
+        state.pause();
+        ecs.reset();
+        state.resume();
+        });
+
+    BENCHMARK("ecs/destroyEntity", "entities", [](bench::State& state) {
+        for (uint64_t done = 0; done < state.iterations; done += BATCH) {
+            const Entity count = Entity(std::min<uint64_t>(BATCH, state.iterations - done));
+            state.pause();
+            auto ecs = make_ecs();
+            const std::vector<Entity> entities = populate(*ecs, count);
+            const std::vector<Entity> order = shuffled(count);
+            state.resume();
+            for (Entity i = 0; i < count; ++i) {
+                ecs->destroyEntity(entities[order[i]]);
+            }
+            state.pause();
+            ecs.reset();
+            state.resume();
+        }
+        state.items = state.iterations;
+        });
+
+    // Removing and re-adding a Material moves the entity out of and back into the system
+    // and the group, the same path a material swap at runtime takes
+    BENCHMARK("ecs/signature_churn", "changes", [](bench::State& state) {
+        state.pause();
+        auto ecs = make_ecs();
+        const std::vector<Entity> entities = populate(*ecs, BATCH);
+        const std::vector<Entity> order = shuffled(BATCH);
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            const Entity entity = entities[order[i % BATCH]];
+            ecs->removeComponent<render::Material>(entity);
+            ecs->addComponent(entity, render::Material{ {0.5, 0.5, 0.5}, 0., 0. });
+        }
+        state.items = 2 * state.iterations;
+        state.pause();
+        ecs.reset();
+        state.resume();
+        });
+
+}
@@ -0,0 +1,75 @@
+// Compares System::entities backed by EntitySet against the std::set<Entity> it replaced:
+// iterating the members once per ray bounce, and churning them the way addComponent and
+// removeComponent do.
+#include <cstdint>
+#include <set>
+#include "harness.h"
+#include "ecs/entity_set.h"
+
+namespace {
+
+    // xorshift, enough to scatter the churn over the entity range
+    uint32_t next_random(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    template <typename Set>
+    void fill(Set& set, Entity count) {
+        for (Entity entity = 0; entity < count; ++entity) {
+            set.insert(entity);
+        }
+    }
+
+    // One operation is a pass over every member
+    template <typename Set>
+    void bench_iterate(bench::State& state, Set set, Entity count) {
+        state.pause();
+        fill(set, count);
+        state.resume();
+        uint64_t sum = 0;
+        for (uint64_t pass = 0; pass < state.iterations; ++pass) {
+            for (const Entity entity : set) {
+                sum += entity;
+            }
+        }
+        bench::keep(sum);
+        state.items = state.iterations * count;
+    }
+
+    // One operation is an erase + insert pair of a random member
+    template <typename Set>
+    void bench_churn(bench::State& state, Set set, Entity count) {
+        state.pause();
+        fill(set, count);
+        state.resume();
+        uint32_t random = 2463534242u;
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            const Entity entity = next_random(random) % count;
+            set.erase(entity);
+            set.insert(entity);
+        }
+        state.items = state.iterations;
+    }
+
+    BENCHMARK("ecs/membership_iterate/std_set/500", "entities", [](bench::State& state) { bench_iterate(state, std::set<Entity>{}, 500); });
+    BENCHMARK("ecs/membership_iterate/std_set/5000", "entities", [](bench::State& state) { bench_iterate(state, std::set<Entity>{}, 5'000); });
+    BENCHMARK("ecs/membership_iterate/std_set/100000", "entities", [](bench::State& state) { bench_iterate(state, std::set<Entity>{}, 100'000); });
+    BENCHMARK("ecs/membership_iterate/entity_set/500", "entities", [](bench::State& state) { bench_iterate(state, EntitySet{}, 500); });
+    BENCHMARK("ecs/membership_iterate/entity_set/5000", "entities", [](bench::State& state) { bench_iterate(state, EntitySet{}, 5'000); });
+    BENCHMARK("ecs/membership_iterate/entity_set/100000", "entities", [](bench::State& state) { bench_iterate(state, EntitySet{}, 100'000); });
+
+    BENCHMARK("ecs/membership_churn/std_set/500", "changes", [](bench::State& state) { bench_churn(state, std::set<Entity>{}, 500); });
+    BENCHMARK("ecs/membership_churn/std_set/5000", "changes", [](bench::State& state) { bench_churn(state, std::set<Entity>{}, 5'000); });
+    BENCHMARK("ecs/membership_churn/std_set/100000", "changes", [](bench::State& state) { bench_churn(state, std::set<Entity>{}, 100'000); });
+    BENCHMARK("ecs/membership_churn/entity_set/500", "changes", [](bench::State& state) { bench_churn(state, EntitySet{}, 500); });
+    BENCHMARK("ecs/membership_churn/entity_set/5000", "changes", [](bench::State& state) { bench_churn(state, EntitySet{}, 5'000); });
+    BENCHMARK("ecs/membership_churn/entity_set/100000", "changes", [](bench::State& state) { bench_churn(state, EntitySet{}, 100'000); });
+    // Stable erase shifts the tail of the members, so its cost grows with the set
+    BENCHMARK("ecs/membership_churn/entity_set_stable/500", "changes", [](bench::State& state) { bench_churn(state, EntitySet{ true }, 500); });
+    BENCHMARK("ecs/membership_churn/entity_set_stable/5000", "changes", [](bench::State& state) { bench_churn(state, EntitySet{ true }, 5'000); });
+    BENCHMARK("ecs/membership_churn/entity_set_stable/100000", "changes", [](bench::State& state) { bench_churn(state, EntitySet{ true }, 100'000); });
+
+}
@@ -0,0 +1,92 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Minimal benchmark harness for cpprtw_bench. Each benchmark body receives a State with
+// the number of operations to run, may pause the clock around setup, and reports how
+// many items (rays, samples, ...) it processed so throughput can be derived.
+namespace bench {
+
+    // Heap allocations made so far on any thread, counted by the operator new in main.cpp
+    uint64_t allocation_count();
+
+    class State {
+    public:
+        explicit State(uint64_t iterations) : iterations(iterations) {}
+
+        uint64_t iterations;
+        uint64_t items = 0; // Work done, reported as items_per_second when non-zero
+
+        // Excludes setup from both the time and the allocation count
+        void pause() {
+            m_elapsed += std::chrono::steady_clock::now() - m_start;
+            m_allocations += allocation_count() - m_allocations_start;
+        }
+        void resume() {
+            m_allocations_start = allocation_count();
+            m_start = std::chrono::steady_clock::now();
+        }
+
+        double elapsed_ns() const {
+            return std::chrono::duration<double, std::nano>(m_elapsed).count();
+        }
+        uint64_t allocations() const {
+            return m_allocations;
+        }
+
+    private:
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::steady_clock::duration m_elapsed{};
+        uint64_t m_allocations_start = 0;
+        uint64_t m_allocations = 0;
+    };
+
+    struct Result {
+        std::string name;
+        std::string item_unit;
+        uint64_t iterations;
+        double ns_per_op;
+        double items_per_second;
+        double allocations_per_op;
+    };
+
+    struct Benchmark {
+        std::string name;
+        std::string item_unit; // What State::items counts, e.g. "rays"
+        std::function<void(State&)> body;
+    };
+
+    // Benchmarks register themselves from static initialisers in each bench_*.cpp
+    std::vector<Benchmark>& registry();
+
+    struct Registration {
+        Registration(std::string name, std::string item_unit, std::function<void(State&)> body) {
+            registry().push_back(Benchmark{ std::move(name), std::move(item_unit), std::move(body) });
+        }
+    };
+
+    // Keeps the optimiser from discarding a computed value
+    template <typename T>
+    inline void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+}
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+// The body is variadic so commas inside the lambda need no extra parentheses
+#define BENCHMARK(name, unit, ...) \
+    static ::bench::Registration BENCH_CONCAT(bench_registration_, __LINE__)(name, unit, __VA_ARGS__)
+
+#endif // BENCH_HARNESS_H
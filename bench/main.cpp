@@ -0,0 +1,162 @@
+// cpprtw_bench: microbenchmarks for the render and ECS hot paths.
+//   cpprtw_bench [--filter <substring>] [--min-time <ms>] [--json <path>]
+// Every fixture is seeded, so two runs measure the same work and their --json output
+// can be compared between commits.
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include "common.h"
+#include "harness.h"
+
+namespace {
+    std::atomic<uint64_t> g_allocations = 0;
+}
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+// AlignedAllocator and alignas(64) types come through here
+void* operator new(size_t size, std::align_val_t alignment) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t align = size_t(alignment);
+    // aligned_alloc wants a size that is a multiple of the alignment
+    const size_t rounded = (std::max<size_t>(size, 1) + align - 1) / align * align;
+    if (void* p = std::aligned_alloc(align, rounded)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+namespace bench {
+
+    uint64_t allocation_count() {
+        return g_allocations.load(std::memory_order_relaxed);
+    }
+
+    std::vector<Benchmark>& registry() {
+        static std::vector<Benchmark> benchmarks;
+        return benchmarks;
+    }
+
+    namespace {
+
+        State run_once(const Benchmark& benchmark, uint64_t iterations) {
+            State state(iterations);
+            state.resume();
+            benchmark.body(state);
+            state.pause();
+            return state;
+        }
+
+        // Grows the iteration count until one run takes min_time, then keeps the fastest of
+        // three runs of that size
+        Result measure(const Benchmark& benchmark, double min_time_ns) {
+            uint64_t iterations = 1;
+            State state = run_once(benchmark, iterations);
+            while (state.elapsed_ns() < min_time_ns && iterations < (uint64_t(1) << 40)) {
+                const double scale = state.elapsed_ns() > 0. ? 1.4 * min_time_ns / state.elapsed_ns() : 10.;
+                iterations = std::max(iterations + 1, uint64_t(double(iterations) * std::min(scale, 10.)));
+                state = run_once(benchmark, iterations);
+            }
+            for (int repeat = 0; repeat < 2; ++repeat) {
+                State again = run_once(benchmark, iterations);
+                if (again.elapsed_ns() < state.elapsed_ns()) {
+                    state = again;
+                }
+            }
+
+            Result result;
+            result.name = benchmark.name;
+            result.item_unit = benchmark.item_unit;
+            result.iterations = iterations;
+            result.ns_per_op = state.elapsed_ns() / double(iterations);
+            result.items_per_second = state.items > 0 ? double(state.items) / (state.elapsed_ns() * 1e-9) : 0.;
+            result.allocations_per_op = double(state.allocations()) / double(iterations);
+            return result;
+        }
+
+        void write_json(const std::vector<Result>& results, std::ostream& out) {
+            out << "{\n  \"precision\": \"" << (sizeof(real) == sizeof(float) ? "float" : "double") << "\",\n";
+            out << "  \"results\": [\n";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const Result& r = results[i];
+                out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                    << ", \"ns_per_op\": " << r.ns_per_op
+                    << ", \"items_per_second\": " << r.items_per_second
+                    << ", \"item_unit\": \"" << r.item_unit << "\""
+                    << ", \"allocations_per_op\": " << r.allocations_per_op << "}"
+                    << (i + 1 < results.size() ? "," : "") << "\n";
+            }
+            out << "  ]\n}\n";
+        }
+
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* filter = nullptr;
+    const char* json_path = nullptr;
+    double min_time_ms = 200.;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time_ms = std::atof(argv[++i]);
+        }
+        else {
+            std::cerr << "usage: " << argv[0] << " [--filter <substring>] [--min-time <ms>] [--json <path>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<bench::Result> results;
+    std::printf("%-32s %12s %14s %24s %10s\n", "benchmark", "iterations", "ns/op", "items/s", "allocs/op");
+    for (const bench::Benchmark& benchmark : bench::registry()) {
+        if (filter != nullptr && benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        const bench::Result r = bench::measure(benchmark, min_time_ms * 1e6);
+        results.push_back(r);
+        char items[32] = "-";
+        if (r.items_per_second > 0.) {
+            std::snprintf(items, sizeof(items), "%.3g %s", r.items_per_second, r.item_unit.c_str());
+        }
+        std::printf("%-32s %12llu %14.2f %24s %10.2f\n", r.name.c_str(), (unsigned long long)r.iterations,
+            r.ns_per_op, items, r.allocations_per_op);
+    }
+
+    if (json_path != nullptr) {
+        std::ofstream out(json_path);
+        if (!out) {
+            std::cerr << "Failed to open " << json_path << std::endl;
+            return 1;
+        }
+        bench::write_json(results, out);
+    }
+    return 0;
+}
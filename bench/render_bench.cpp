@@ -0,0 +1,400 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "camera.h"
+#include "ecs/ECS.h"
+#include "geometry/hittable.h"
+#include "geometry/triangle_mesh.h"
+#include "material/material.h"
+#include "obj_file.h"
+#include "render_system.h"
+#include "scene_snapshot.h"
+#include "thread_pool.h"
+
+namespace {
+
+    constexpr uint64_t SEED = 3;
+
+    // Ground sphere plus sphere_count - 1 small spheres on a jittered grid, with the
+    // material mix of the main scene. With moving, the small spheres rise like the main
+    // scene's diffuse ones; their placement does not change.
+    render::SceneSnapshot make_scene(int sphere_count, bool moving = false) {
+        ECS ecs;
+        ecs.registerComponent<render::Sphere>();
+        ecs.registerComponent<render::Material>();
+        ecs.registerGroup<render::Sphere, render::Material>();
+
+        const Entity ground = ecs.createEntity();
+        ecs.addComponent(ground, render::Sphere{ {0., -1000., 0.}, 1000. });
+        ecs.addComponent(ground, render::Material{ {0.5, 0.5, 0.5}, 0., 0. });
+
+        RNG rng(SEED);
+        RNG motion_rng(SEED + 1);
+        const int side = int(std::ceil(std::sqrt(double(sphere_count - 1))));
+        const real spacing = real(22) / real(std::max(side, 1));
+        const real radius = real(0.2) * std::min(real(1), spacing);
+        for (int i = 0; i + 1 < sphere_count; ++i) {
+            const real a = real(-11) + spacing * (real(i % side) + real(0.9) * rng.random_real());
+            const real b = real(-11) + spacing * (real(i / side) + real(0.9) * rng.random_real());
+            const Entity sphere = ecs.createEntity();
+            const real choose_mat = rng.random_real();
+            const vec3 direction(0., moving ? motion_rng.random_real(0, 0.5) : 0., 0.);
+            ecs.addComponent(sphere, render::Sphere{ point3(a, radius, b), radius, direction });
+            if (choose_mat < real(0.8)) {
+                ecs.addComponent(sphere, render::Material{ random_vec3(rng) * random_vec3(rng), 0., 0. });
+            }
+            else if (choose_mat < real(0.95)) {
+                ecs.addComponent(sphere, render::Material{ random_vec3(rng), 1., 0., rng.random_real(0, 0.5) });
+            }
+            else {
+                ecs.addComponent(sphere, render::Material{ {0., 0., 0.}, 0., 1., 0., 1.5 });
+            }
+        }
+        return render::SceneSnapshot::compile(ecs);
+    }
+
+    // Pinhole camera at the main scene's viewpoint
+    render::Camera make_camera(int width, int height, int samples_per_pixel) {
+        const point3 lookfrom(13., 2., 3.);
+        const point3 lookat(0., 0., 0.);
+        const vec3 vup(0., 1., 0.);
+        const vec3 w = glm::normalize(lookfrom - lookat);
+        const vec3 u = glm::normalize(glm::cross(vup, w));
+        const vec3 v = glm::cross(w, u);
+        const real focus_dist = 10.;
+        const real viewport_height = 2 * real(std::tan(degrees_to_radians(20.) / 2)) * focus_dist;
+        const real viewport_width = viewport_height * (real(width) / real(height));
+        const vec3 viewport_u = viewport_width * u;
+        const vec3 viewport_v = viewport_height * -v;
+
+        render::Camera cam;
+        cam.width = width;
+        cam.height = height;
+        cam.samples_per_pixel = samples_per_pixel;
+        cam.camera_center = lookfrom;
+        cam.u = u;
+        cam.v = v;
+        cam.w = w;
+        cam.pixel_delta_u = viewport_u / real(width);
+        cam.pixel_delta_v = viewport_v / real(height);
+        cam.pixel_00_loc = lookfrom - focus_dist * w - viewport_u / real(2) - viewport_v / real(2)
+            + real(0.5) * (cam.pixel_delta_u + cam.pixel_delta_v);
+        cam.defocus_angle = 0.;
+        cam.defocus_disk_u = vec3(0., 0., 0.);
+        cam.defocus_disk_v = vec3(0., 0., 0.);
+        return cam;
+    }
+
+    // Camera rays over the whole image, reused by the intersection benchmarks
+    std::vector<render::Ray> make_rays(size_t count) {
+        const render::Camera cam = make_camera(256, 144, 1);
+        RNG rng(SEED);
+        std::vector<render::Ray> rays;
+        rays.reserve(count);
+        for (size_t k = 0; k < count; ++k) {
+            const int x = int(rng.next_u64() % uint64_t(cam.width));
+            const int y = int(rng.next_u64() % uint64_t(cam.height));
+            rays.push_back(cam.get_ray(x, y, rng));
+        }
+        return rays;
+    }
+
+    // Latitude-longitude sphere of radius 2 on the ground, rings * 2 * rings quads split
+    // into twice as many triangles, in front of the benchmark camera
+    render::MeshBuffers make_sphere_mesh(int rings) {
+        const int segments = 2 * rings;
+        const point3 center(0., 2., 0.);
+        render::MeshBuffers mesh;
+        for (int i = 0; i <= rings; ++i) {
+            const double theta = M_PI * double(i) / double(rings);
+            for (int j = 0; j < segments; ++j) {
+                const double phi = 2. * M_PI * double(j) / double(segments);
+                mesh.positions.push_back(center + real(2) * point3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+            }
+        }
+        for (int i = 0; i < rings; ++i) {
+            for (int j = 0; j < segments; ++j) {
+                const uint32_t a = uint32_t(i * segments + j);
+                const uint32_t b = uint32_t(i * segments + (j + 1) % segments);
+                const uint32_t c = b + uint32_t(segments);
+                const uint32_t d = a + uint32_t(segments);
+                mesh.indices.insert(mesh.indices.end(), { a, b, c, a, c, d });
+            }
+        }
+        return mesh;
+    }
+
+    // make_sphere_mesh written as an OBJ file of quads, removed when the benchmarks exit
+    struct ObjFixture {
+        std::string path;
+        size_t triangles;
+
+        explicit ObjFixture(int rings) {
+            const render::MeshBuffers mesh = make_sphere_mesh(rings);
+            triangles = mesh.triangle_count();
+            path = (std::filesystem::temp_directory_path() / ("cpprtw_bench_" + std::to_string(rings) + ".obj")).string();
+            std::ofstream out(path);
+            char line[96];
+            for (const point3& p : mesh.positions) {
+                std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", double(p.x), double(p.y), double(p.z));
+                out << line;
+            }
+            for (size_t i = 0; i < mesh.indices.size(); i += 6) {
+                out << "f " << mesh.indices[i] + 1 << ' ' << mesh.indices[i + 1] + 1 << ' '
+                    << mesh.indices[i + 2] + 1 << ' ' << mesh.indices[i + 5] + 1 << '\n';
+            }
+        }
+        ~ObjFixture() {
+            std::remove(path.c_str());
+        }
+    };
+
+    void bench_load_obj(bench::State& state, int rings) {
+        state.pause();
+        static ThreadPool pool;
+        const ObjFixture fixture(rings);
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            bench::keep(render::load_obj(fixture.path, pool).indices.data());
+        }
+        state.items = state.iterations * fixture.triangles;
+    }
+
+    void bench_hit_mesh(bench::State& state, int rings) {
+        state.pause();
+        const render::TriangleMesh mesh{ std::make_shared<const render::MeshBuffers>(make_sphere_mesh(rings)) };
+        const render::SceneSnapshot scene = render::SceneSnapshot::compile({}, {}, { mesh }, { render::Material{ {0.5, 0.5, 0.5}, 0., 0. } });
+        const std::vector<render::Ray> rays = make_rays(4096);
+        const render::RenderSystem system;
+        render::ThreadCounters counters;
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            bench::keep(system.hit(scene, rays[i % rays.size()], render::Interval(0, infinity), counters));
+        }
+        state.items = state.iterations;
+    }
+
+    // Hit on top of a unit sphere at the origin, as seen by a ray coming down at an angle
+    struct ShadingFixture {
+        render::Ray ray{ point3(0., 3., 1.), glm::normalize(vec3(0., -2., -1.)), color(1., 1., 1.), 0, 100 };
+        render::HitRecord rec{ real(2.236), point3(0., 1., 0.), vec3(0., 1., 0.), ray };
+    };
+
+    void bench_hit(bench::State& state, int sphere_count, bool moving = false) {
+        state.pause();
+        const render::SceneSnapshot scene = make_scene(sphere_count, moving);
+        const std::vector<render::Ray> rays = make_rays(4096);
+        const render::RenderSystem system;
+        render::ThreadCounters counters;
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            bench::keep(system.hit(scene, rays[i % rays.size()], render::Interval(0, infinity), counters));
+        }
+        state.items = state.iterations;
+    }
+
+    void bench_scatter(bench::State& state, render::ScatterKind kind, const render::Material& mat) {
+        const render::RenderSystem system;
+        const ShadingFixture fixture;
+        RNG rng(SEED);
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            switch (kind) {
+            case render::ScatterKind::Lambertian:
+                bench::keep(system.scatter_lambertian(mat, fixture.ray, fixture.rec, rng));
+                break;
+            case render::ScatterKind::Dielectric:
+                bench::keep(system.scatter_dielectric(mat, fixture.ray, fixture.rec, rng));
+                break;
+            default:
+                bench::keep(system.scatter_metallic(mat, fixture.ray, fixture.rec, rng));
+                break;
+            }
+        }
+        state.items = state.iterations;
+    }
+
+    BENCHMARK("rng/random_double", "numbers", [](bench::State& state) {
+        RNG rng(SEED);
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            bench::keep(rng.random_double());
+        }
+        state.items = state.iterations;
+        });
+
+    BENCHMARK("camera/get_ray", "rays", [](bench::State& state) {
+        const render::Camera cam = make_camera(256, 144, 1);
+        RNG rng(SEED);
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            const int pixel = int(i % uint64_t(cam.width * cam.height));
+            bench::keep(cam.get_ray(pixel % cam.width, pixel / cam.width, rng));
+        }
+        state.items = state.iterations;
+        });
+
+    BENCHMARK("render/hit_sphere", "rays", [](bench::State& state) {
+        state.pause();
+        const std::vector<render::Ray> rays = make_rays(4096);
+        const render::Sphere sphere{ point3(0., 1., 0.), 1. };
+        const render::RenderSystem system;
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            bench::keep(system.hit_sphere(sphere, rays[i % rays.size()], render::Interval(0, infinity)));
+        }
+        state.items = state.iterations;
+        });
+
+    BENCHMARK("render/hit/16", "rays", [](bench::State& state) { bench_hit(state, 16); });
+    BENCHMARK("render/hit/256", "rays", [](bench::State& state) { bench_hit(state, 256); });
+    BENCHMARK("render/hit/4096", "rays", [](bench::State& state) { bench_hit(state, 4096); });
+    BENCHMARK("render/hit/65536", "rays", [](bench::State& state) { bench_hit(state, 65536); });
+    // Same scenes with every small sphere moving, should stay close to the static ones
+    BENCHMARK("render/hit_moving/256", "rays", [](bench::State& state) { bench_hit(state, 256, true); });
+    BENCHMARK("render/hit_moving/4096", "rays", [](bench::State& state) { bench_hit(state, 4096, true); });
+
+    BENCHMARK("render/scatter_lambertian", "rays", [](bench::State& state) {
+        bench_scatter(state, render::ScatterKind::Lambertian, render::Material{ {0.5, 0.5, 0.5}, 0., 0. });
+        });
+    BENCHMARK("render/scatter_metallic", "rays", [](bench::State& state) {
+        bench_scatter(state, render::ScatterKind::Metallic, render::Material{ {0.7, 0.6, 0.5}, 1., 0., 0.1 });
+        });
+    BENCHMARK("render/scatter_dielectric", "rays", [](bench::State& state) {
+        bench_scatter(state, render::ScatterKind::Dielectric, render::Material{ {0., 0., 0.}, 0., 1., 0., 1.5 });
+        });
+
+    BENCHMARK("render/hit_triangle", "rays", [](bench::State& state) {
+        state.pause();
+        const std::vector<render::Ray> rays = make_rays(4096);
+        const point3 p0(-2., 0., -1.), p1(2., 0., -1.), p2(0., 3., 1.);
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            real t;
+            bench::keep(render::intersect_triangle(render::WatertightRay(rays[i % rays.size()]), p0, p1, p2, 0, infinity, t));
+        }
+        state.items = state.iterations;
+        });
+
+    // Tessellated spheres of 8K and 512K triangles through the mesh BVH
+    BENCHMARK("render/hit_mesh/8k", "rays", [](bench::State& state) { bench_hit_mesh(state, 64); });
+    BENCHMARK("render/hit_mesh/512k", "rays", [](bench::State& state) { bench_hit_mesh(state, 512); });
+
+    // Parse time of whole OBJ files on every hardware thread, in triangles per second
+    BENCHMARK("mesh/load_obj/8k", "triangles", [](bench::State& state) { bench_load_obj(state, 64); });
+    BENCHMARK("mesh/load_obj/512k", "triangles", [](bench::State& state) { bench_load_obj(state, 512); });
+
+    // One 32x32 tile at 4 spp of the 256-sphere scene per op, on the calling thread
+    void bench_render_tile(bench::State& state, int packet_size, render::PixelOrder order,
+        render::SamplerKind sampler = render::RenderSettings{}.sampler) {
+        state.pause();
+        const render::SceneSnapshot scene = make_scene(256);
+        const render::Camera cam = make_camera(256, 144, 4);
+        render::RenderSystem system;
+        system.settings.packet_size = packet_size;
+        system.settings.pixel_order = order;
+        system.settings.sampler = sampler;
+        render::TileBuffer tile;
+        render::ThreadCounters counters;
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            tile.reset(112, 144, 56, 88);
+            system.render_tile(scene, cam, tile, counters, RNG(SEED));
+        }
+        state.items = state.iterations * 32 * 32 * uint64_t(cam.samples_per_pixel);
+    }
+
+    // First hits of the camera rays of a 32x32 tile of the 4096-sphere scene, one by one
+    // or in packet_size x packet_size packets
+    void bench_primary(bench::State& state, int packet_size) {
+        state.pause();
+        const render::SceneSnapshot scene = make_scene(4096);
+        const render::Camera cam = make_camera(256, 144, 1);
+        const render::RenderSystem system;
+        render::ThreadCounters counters;
+        const int block = std::max(packet_size, 1);
+        std::vector<render::Ray> rays;
+        RNG rng(SEED);
+        for (int by = 56; by < 88; by += block) {
+            for (int bx = 112; bx < 144; bx += block) {
+                for (int y = by; y < by + block; ++y) {
+                    for (int x = bx; x < bx + block; ++x) {
+                        rays.push_back(cam.get_ray(x, y, rng));
+                    }
+                }
+            }
+        }
+        render::RayPacket packet;
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            if (packet_size == 0) {
+                for (const render::Ray& r : rays) {
+                    real t;
+                    bench::keep(system.closest_slot(scene, r, render::Interval(0, infinity), t, counters));
+                }
+                continue;
+            }
+            for (size_t first = 0; first < rays.size(); first += size_t(block * block)) {
+                packet.clear();
+                for (int k = 0; k < block * block; ++k) {
+                    packet.push_back(rays[first + size_t(k)], infinity);
+                }
+                system.closest_slots(scene, packet, counters);
+                bench::keep(packet.slot[0]);
+            }
+        }
+        state.items = state.iterations * rays.size();
+    }
+
+    BENCHMARK("render/primary/single", "rays", [](bench::State& state) { bench_primary(state, 0); });
+    BENCHMARK("render/primary/packet4x4", "rays", [](bench::State& state) { bench_primary(state, 4); });
+    BENCHMARK("render/primary/packet8x8", "rays", [](bench::State& state) { bench_primary(state, 8); });
+
+    BENCHMARK("render/render_tile/32x32x4", "samples", [](bench::State& state) {
+        bench_render_tile(state, render::RenderSettings{}.packet_size, render::RenderSettings{}.pixel_order);
+        });
+    // The path before packets, for comparison
+    BENCHMARK("render/render_tile/32x32x4/single_scanline", "samples", [](bench::State& state) {
+        bench_render_tile(state, 0, render::PixelOrder::Scanline);
+        });
+    BENCHMARK("render/render_tile/32x32x4/packet8x8", "samples", [](bench::State& state) {
+        bench_render_tile(state, 8, render::PixelOrder::Morton);
+        });
+    // The cost of the samplers, sampler_convergence measures what they buy
+    BENCHMARK("render/render_tile/32x32x4/random", "samples", [](bench::State& state) {
+        bench_render_tile(state, render::RenderSettings{}.packet_size, render::RenderSettings{}.pixel_order, render::SamplerKind::Random);
+        });
+    BENCHMARK("render/render_tile/32x32x4/bluenoise", "samples", [](bench::State& state) {
+        bench_render_tile(state, render::RenderSettings{}.packet_size, render::RenderSettings{}.pixel_order, render::SamplerKind::BlueNoise);
+        });
+
+    // The edge-avoiding filter over a 256x144 frame of the 256-sphere scene at 4 spp, on
+    // every hardware thread
+    void bench_denoise(bench::State& state) {
+        state.pause();
+        static ThreadPool pool;
+        const render::SceneSnapshot scene = make_scene(256);
+        const render::Camera cam = make_camera(256, 144, 4);
+        const render::RenderSystem system;
+        render::TileBuffer frame;
+        frame.reset(0, cam.width, 0, cam.height, true);
+        render::ThreadCounters counters;
+        system.render_tile(scene, cam, frame, counters, RNG(SEED));
+        const size_t pixels = size_t(cam.width) * size_t(cam.height);
+        std::vector<float> image(pixels * 3);
+        render::AuxiliaryBuffers auxiliary{ std::vector<float>(pixels * 3), std::vector<float>(pixels * 3), std::vector<float>(pixels) };
+        for (int y = 0; y < cam.height; ++y) {
+            const size_t first = size_t(y) * size_t(cam.width);
+            frame.resolve_row(y, &image[first * 3]);
+            frame.resolve_features_row(y, &auxiliary.albedo[first * 3], &auxiliary.normal[first * 3], &auxiliary.depth[first]);
+        }
+        state.resume();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            bench::keep(render::denoise(image, auxiliary, cam.width, cam.height, render::DenoiseSettings{}, pool).data());
+        }
+        state.items = state.iterations * pixels;
+    }
+
+    BENCHMARK("render/denoise/256x144", "pixels", [](bench::State& state) { bench_denoise(state); });
+}
@@ -0,0 +1,157 @@
+// Convergence of the samplers in sampler.h: renders a small scene with defocus blur,
+// motion blur and every material at doubling sample counts with each sampler, and prints
+// the RMSE against a high-spp reference. The last two columns are the spp the Random
+// sampler needs for the same error, from its MSE falling as 1 / spp.
+//   cpprtw_bench_convergence [--max-spp N] [--reference-spp N]
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "camera.h"
+#include "geometry/hittable.h"
+#include "material/material.h"
+#include "render_system.h"
+#include "scene_snapshot.h"
+#include "thread_pool.h"
+
+namespace {
+
+    constexpr int WIDTH = 160;
+    constexpr int HEIGHT = 90;
+    constexpr int TILE = 32;
+    constexpr uint64_t SEED = 3;
+    // The reference's own seed, so its samples share nothing with the measured renders
+    constexpr uint64_t REFERENCE_SEED = 1234567;
+
+    // The main scene's three large spheres, the left one rising, over a ring of small ones
+    render::SceneSnapshot make_scene() {
+        std::vector<render::Sphere> spheres{
+            render::Sphere{ {0., -1000., 0.}, 1000. },
+            render::Sphere{ {0., 1., 0.}, 1. },
+            render::Sphere{ {-4., 1., 0.}, 1., {0., 0.5, 0.} },
+            render::Sphere{ {4., 1., 0.}, 1. },
+        };
+        std::vector<render::Material> materials{
+            render::Material{ {0.5, 0.5, 0.5}, 0., 0. },
+            render::Material{ {1., 1., 1.}, 0., 1., 0., 1.5 },
+            render::Material{ {0.4, 0.2, 0.1}, 0., 0. },
+            render::Material{ {0.7, 0.6, 0.5}, 1., 0., 0.1 },
+        };
+        for (int i = 0; i < 12; ++i) {
+            const double angle = 2. * M_PI * double(i) / 12.;
+            spheres.push_back(render::Sphere{ point3(6. * std::cos(angle), 0.3, 6. * std::sin(angle)), 0.3 });
+            materials.push_back(i % 3 == 0
+                ? render::Material{ {0.8, 0.8, 0.9}, 1., 0., 0.3 }
+                : render::Material{ {0.2 + 0.05 * i, 0.6, 0.9 - 0.05 * i}, 0., 0. });
+        }
+        return render::SceneSnapshot::compile(spheres, materials, {}, {});
+    }
+
+    // The main scene's view, focused on the middle sphere
+    render::Camera make_camera(int samples_per_pixel) {
+        const point3 lookfrom(13., 2., 3.);
+        const point3 lookat(0., 0., 0.);
+        const vec3 vup(0., 1., 0.);
+        const vec3 w = glm::normalize(lookfrom - lookat);
+        const vec3 u = glm::normalize(glm::cross(vup, w));
+        const vec3 v = glm::cross(w, u);
+        const real focus_dist = 10.;
+        const real viewport_height = 2 * real(std::tan(degrees_to_radians(20.) / 2)) * focus_dist;
+        const real viewport_width = viewport_height * (real(WIDTH) / real(HEIGHT));
+        const vec3 viewport_u = viewport_width * u;
+        const vec3 viewport_v = viewport_height * -v;
+
+        render::Camera cam;
+        cam.width = WIDTH;
+        cam.height = HEIGHT;
+        cam.samples_per_pixel = samples_per_pixel;
+        cam.camera_center = lookfrom;
+        cam.u = u;
+        cam.v = v;
+        cam.w = w;
+        cam.pixel_delta_u = viewport_u / real(WIDTH);
+        cam.pixel_delta_v = viewport_v / real(HEIGHT);
+        cam.pixel_00_loc = lookfrom - focus_dist * w - viewport_u / real(2) - viewport_v / real(2)
+            + real(0.5) * (cam.pixel_delta_u + cam.pixel_delta_v);
+        cam.defocus_angle = 0.6;
+        const real defocus_radius = focus_dist * real(std::tan(degrees_to_radians(cam.defocus_angle / 2)));
+        cam.defocus_disk_u = u * defocus_radius;
+        cam.defocus_disk_v = v * defocus_radius;
+        return cam;
+    }
+
+    // The frame as RGB floats, its tiles rendered on pool through render_tile so no
+    // progress bar or stats get in the way of the table
+    std::vector<float> render_frame(const render::SceneSnapshot& scene, render::SamplerKind sampler, int spp,
+        uint64_t seed, ThreadPool& pool) {
+        const render::Camera cam = make_camera(spp);
+        render::RenderSystem system;
+        system.settings.sampler = sampler;
+        const int columns = (WIDTH + TILE - 1) / TILE;
+        const int rows = (HEIGHT + TILE - 1) / TILE;
+        std::vector<float> image(size_t(WIDTH) * HEIGHT * 3);
+        pool.parallel_for(size_t(columns * rows), [&](size_t t) {
+            const int i0 = int(t) % columns * TILE;
+            const int j0 = int(t) / columns * TILE;
+            render::TileBuffer tile;
+            tile.reset(i0, std::min(i0 + TILE, WIDTH), j0, std::min(j0 + TILE, HEIGHT));
+            render::ThreadCounters counters;
+            system.render_tile(scene, cam, tile, counters, RNG(seed));
+            for (int y = tile.j0; y < tile.j0 + tile.height; ++y) {
+                tile.resolve_row(y, &image[(size_t(y) * WIDTH + size_t(i0)) * 3]);
+            }
+            });
+        return image;
+    }
+
+    double mse(const std::vector<float>& image, const std::vector<float>& reference) {
+        double sum = 0.;
+        for (size_t i = 0; i < image.size(); ++i) {
+            const double difference = double(image[i]) - double(reference[i]);
+            sum += difference * difference;
+        }
+        return sum / double(image.size());
+    }
+
+}
+
+int main(int argc, char** argv) {
+    int max_spp = 128;
+    int reference_spp = 4096;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--max-spp") == 0 && i + 1 < argc) {
+            max_spp = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--reference-spp") == 0 && i + 1 < argc) {
+            reference_spp = std::atoi(argv[++i]);
+        }
+        else {
+            std::fprintf(stderr, "usage: %s [--max-spp N] [--reference-spp N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    ThreadPool pool;
+    const render::SceneSnapshot scene = make_scene();
+    // Sobol converges fastest, so it makes the most accurate reference for the time
+    std::printf("reference: %dx%d at %d spp\n", WIDTH, HEIGHT, reference_spp);
+    const std::vector<float> reference = render_frame(scene, render::SamplerKind::Sobol, reference_spp, REFERENCE_SEED, pool);
+
+    const render::SamplerKind samplers[] = {
+        render::SamplerKind::Random, render::SamplerKind::Sobol, render::SamplerKind::BlueNoise
+    };
+    std::printf("%6s %12s %12s %12s %16s %16s\n", "spp", "random", "sobol", "bluenoise", "sobol as spp", "bluenoise as spp");
+    for (int spp = 1; spp <= max_spp; spp *= 2) {
+        double errors[3];
+        for (int k = 0; k < 3; ++k) {
+            errors[k] = mse(render_frame(scene, samplers[k], spp, SEED, pool), reference);
+        }
+        // Random sampling's MSE is its per-sample variance over spp
+        const double variance = errors[0] * double(spp);
+        std::printf("%6d %12.5f %12.5f %12.5f %16.1f %16.1f\n", spp, std::sqrt(errors[0]), std::sqrt(errors[1]),
+            std::sqrt(errors[2]), variance / errors[1], variance / errors[2]);
+    }
+    return 0;
+}
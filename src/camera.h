@@ -16,7 +16,7 @@ namespace render {
         vec3 pixel_00_loc; // Location of the upper left pixel
         vec3 pixel_delta_u; // Delta vector across the horizontal viewport edge
         vec3 pixel_delta_v; // Delta vector down the vertical viewport edge
-        double defocus_angle;
+        real defocus_angle;
         vec3 defocus_disk_u, defocus_disk_v;
 
         point3 defocus_disk_sample(RNG& rng) const {
@@ -25,14 +25,17 @@ namespace render {
             return camera_center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
         }
 
+        // Draws the jitter, lens and time dimensions in the order sampler.h lays them out.
+        // The lens is drawn even for a pinhole, so time stays on its own dimension.
         Ray get_ray(int i, int j, RNG& rng) const {
             assert(i >= 0 && i < width && j >= 0 && j < height && "tile limits out of bounds");
-            const double offset_x = rng.random_double(-0.5, 0.5);
-            const double offset_y = rng.random_double(-0.5, 0.5);
-            const auto pixel_sample = pixel_00_loc + ((double(i) + offset_x) * pixel_delta_u) + ((double(j) + offset_y) * pixel_delta_v);
-            const auto ray_origin = (defocus_angle <= 0) ? camera_center : defocus_disk_sample(rng);
+            const real offset_x = rng.random_real(-0.5, 0.5);
+            const real offset_y = rng.random_real(-0.5, 0.5);
+            const auto pixel_sample = pixel_00_loc + ((real(i) + offset_x) * pixel_delta_u) + ((real(j) + offset_y) * pixel_delta_v);
+            const auto lens_sample = defocus_disk_sample(rng);
+            const auto ray_origin = (defocus_angle <= 0) ? camera_center : lens_sample;
             const auto ray_direction = glm::normalize(pixel_sample - ray_origin);
-            const auto ray_time = rng.random_double();
+            const auto ray_time = rng.random_real();
             return Ray(ray_origin, ray_direction, ray_time, color(1., 1., 1.), j * width + i, max_depth);
         } // Ray from the camera center through the pixel center
 
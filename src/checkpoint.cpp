@@ -0,0 +1,166 @@
+#include "checkpoint.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace render {
+
+	namespace {
+		// The trailing digit is the format version, bumped whenever the layout below changes
+		constexpr char MAGIC[8] = { 'C', 'P', 'R', 'T', 'C', 'K', 'P', '3' };
+
+		// Values are stored in host byte order, reals always as doubles so a checkpoint
+		// moves between precision builds
+		template <typename T>
+		void write_value(std::ostream& out, const T& value) {
+			out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template <typename T>
+		T read_value(std::istream& in) {
+			T value{};
+			in.read(reinterpret_cast<char*>(&value), sizeof(T));
+			return value;
+		}
+
+		template <typename V>
+		void write_vec3(std::ostream& out, const V& v) {
+			write_value(out, double(v.x));
+			write_value(out, double(v.y));
+			write_value(out, double(v.z));
+		}
+
+		vec3 read_vec3(std::istream& in) {
+			const double x = read_value<double>(in);
+			const double y = read_value<double>(in);
+			const double z = read_value<double>(in);
+			return vec3(real(x), real(y), real(z));
+		}
+	}
+
+	Checkpoint::Checkpoint(const Camera& cam, uint64_t seed, SamplerKind sampler)
+		: camera(cam),
+		seed(seed),
+		sampler(sampler),
+		colors(size_t(cam.width) * size_t(cam.height), accum_color(0., 0., 0.)),
+		stats(size_t(cam.width) * size_t(cam.height)) {
+	}
+
+	Checkpoint Checkpoint::load(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		char magic[sizeof(MAGIC)] = {};
+		in.read(magic, sizeof(magic));
+		if (!in || !std::equal(magic, magic + sizeof(MAGIC), MAGIC)) {
+			throw std::runtime_error(path + " is not a render checkpoint");
+		}
+
+		Checkpoint checkpoint;
+		Camera& cam = checkpoint.camera;
+		checkpoint.seed = read_value<uint64_t>(in);
+		const uint8_t sampler = read_value<uint8_t>(in);
+		checkpoint.sampler = SamplerKind(sampler);
+		checkpoint.russian_roulette = read_value<uint8_t>(in) != 0;
+		checkpoint.roulette_bounces = read_value<int32_t>(in);
+		checkpoint.roulette_max_survival = read_value<double>(in);
+		cam.width = read_value<int32_t>(in);
+		cam.height = read_value<int32_t>(in);
+		cam.samples_per_pixel = read_value<int32_t>(in);
+		cam.max_depth = read_value<int32_t>(in);
+		cam.camera_center = read_vec3(in);
+		cam.u = read_vec3(in);
+		cam.v = read_vec3(in);
+		cam.w = read_vec3(in);
+		cam.pixel_00_loc = read_vec3(in);
+		cam.pixel_delta_u = read_vec3(in);
+		cam.pixel_delta_v = read_vec3(in);
+		cam.defocus_angle = real(read_value<double>(in));
+		cam.defocus_disk_u = read_vec3(in);
+		cam.defocus_disk_v = read_vec3(in);
+		if (!in || cam.width <= 0 || cam.height <= 0 || sampler > uint8_t(SamplerKind::BlueNoise)) {
+			throw std::runtime_error(path + " has a corrupt header");
+		}
+
+		const size_t pixels = size_t(cam.width) * size_t(cam.height);
+		checkpoint.colors.resize(pixels);
+		checkpoint.stats.resize(pixels);
+		for (size_t k = 0; k < pixels; ++k) {
+			const double r = read_value<double>(in);
+			const double g = read_value<double>(in);
+			const double b = read_value<double>(in);
+			checkpoint.colors[k] = accum_color(accum_real(r), accum_real(g), accum_real(b));
+			PixelStats& stats = checkpoint.stats[k];
+			stats.count = read_value<int32_t>(in);
+			stats.mean = read_value<double>(in);
+			stats.m2 = read_value<double>(in);
+		}
+		if (!in) {
+			throw std::runtime_error(path + " is truncated");
+		}
+		return checkpoint;
+	}
+
+	void Checkpoint::save(const std::string& path) const {
+		const std::string temp_path = path + ".tmp";
+		{
+			std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+			out.write(MAGIC, sizeof(MAGIC));
+			write_value(out, seed);
+			write_value(out, uint8_t(sampler));
+			write_value(out, uint8_t(russian_roulette));
+			write_value(out, int32_t(roulette_bounces));
+			write_value(out, roulette_max_survival);
+			write_value(out, int32_t(camera.width));
+			write_value(out, int32_t(camera.height));
+			write_value(out, int32_t(camera.samples_per_pixel));
+			write_value(out, int32_t(camera.max_depth));
+			write_vec3(out, camera.camera_center);
+			write_vec3(out, camera.u);
+			write_vec3(out, camera.v);
+			write_vec3(out, camera.w);
+			write_vec3(out, camera.pixel_00_loc);
+			write_vec3(out, camera.pixel_delta_u);
+			write_vec3(out, camera.pixel_delta_v);
+			write_value(out, double(camera.defocus_angle));
+			write_vec3(out, camera.defocus_disk_u);
+			write_vec3(out, camera.defocus_disk_v);
+			for (size_t k = 0; k < colors.size(); ++k) {
+				write_vec3(out, colors[k]);
+				write_value(out, int32_t(stats[k].count));
+				write_value(out, stats[k].mean);
+				write_value(out, stats[k].m2);
+			}
+			if (!out.flush()) {
+				throw std::runtime_error("Cannot write " + temp_path);
+			}
+		}
+#ifdef _WIN32
+		// std::rename does not replace an existing file on Windows
+		std::remove(path.c_str());
+#endif
+		if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+			throw std::runtime_error("Cannot replace " + path);
+		}
+	}
+
+	void Checkpoint::load_tile(TileBuffer& tile) const {
+		for (int y = tile.j0; y < tile.j0 + tile.height; ++y) {
+			const size_t row = size_t(y) * size_t(camera.width);
+			for (int x = tile.i0; x < tile.i0 + tile.width; ++x) {
+				tile.colors[tile.index(x, y)] = colors[row + x];
+				tile.stats[tile.index(x, y)] = stats[row + x];
+			}
+		}
+	}
+
+	void Checkpoint::store_tile(const TileBuffer& tile) {
+		for (int y = tile.j0; y < tile.j0 + tile.height; ++y) {
+			const size_t row = size_t(y) * size_t(camera.width);
+			for (int x = tile.i0; x < tile.i0 + tile.width; ++x) {
+				colors[row + x] = tile.colors[tile.index(x, y)];
+				stats[row + x] = tile.stats[tile.index(x, y)];
+			}
+		}
+	}
+
+}
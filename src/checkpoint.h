@@ -0,0 +1,44 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "camera.h"
+#include "sampler.h"
+#include "tile_buffer.h"
+
+namespace render {
+
+    // Full-frame sample state of a render, enough to continue or extend it later: the raw
+    // sample sums and per-pixel statistics, the camera, the seed, the sampler and the
+    // Russian roulette settings. Samples are keyed on (seed, pixel, sample index), so a
+    // resumed render with the same sampler and roulette draws exactly the samples the
+    // uninterrupted one would have.
+    struct Checkpoint {
+        Camera camera;
+        uint64_t seed = 0;
+        SamplerKind sampler = SamplerKind::Random;
+        // RenderSettings' roulette fields of the render, see there
+        bool russian_roulette = false;
+        int roulette_bounces = 0;
+        double roulette_max_survival = 1.;
+        std::vector<accum_color> colors; // Row-major, camera.width * camera.height
+        std::vector<PixelStats> stats;
+
+        Checkpoint() = default;
+        // Empty frame for cam
+        Checkpoint(const Camera& cam, uint64_t seed, SamplerKind sampler);
+
+        // Both throw std::runtime_error. save() writes path + ".tmp" and renames it over
+        // path, so an interrupted save leaves the previous checkpoint intact.
+        static Checkpoint load(const std::string& path);
+        void save(const std::string& path) const;
+
+        // Copies the tile's region between the frame and a tile buffer covering it
+        void load_tile(TileBuffer& tile) const;
+        void store_tile(const TileBuffer& tile);
+    };
+
+}
+#endif // CHECKPOINT_H
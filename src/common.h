@@ -6,67 +6,183 @@
 #include <glm/gtx/norm.hpp>
 #include <algorithm>
 #include <functional>
-#include <random>
+#include <cstdint>
+#include <type_traits>
 #include <glm/glm.hpp>
-using point3 = glm::dvec3;
-using color = glm::dvec3;
-using vec3 = glm::dvec3;
-
-constexpr double infinity = std::numeric_limits<double>::infinity();
+#include "sampler.h"
+
+// Scalar type of the render path, picked at build time with the CPPRTW_PRECISION cache option:
+//  - double: everything in double precision (reference)
+//  - float: rays, hits, geometry, materials and pixel accumulators in float
+//  - mixed: float everywhere except the per-pixel accumulators
+// Error against the double reference: float hit points are good to about 1e-7 of the scene
+// extent, far below the 1e-3 offset scattered rays start from, so no extra self-intersection
+// shows up. A float accumulator drifts by at most samples * 6e-8 relative, under the 1/255
+// output step up to ~60k samples per pixel; past that use mixed.
+#if defined(CPPRTW_PRECISION_FLOAT) || defined(CPPRTW_PRECISION_MIXED)
+using real = float;
+#else
+using real = double;
+#endif
+#if defined(CPPRTW_PRECISION_FLOAT)
+using accum_real = float;
+#else
+using accum_real = double;
+#endif
+
+using point3 = glm::vec<3, real>;
+using color = glm::vec<3, real>;
+using vec3 = glm::vec<3, real>;
+using accum_color = glm::vec<3, accum_real>; // Per-pixel sums of many samples
+
+constexpr real infinity = std::numeric_limits<real>::infinity();
 
 constexpr inline double degrees_to_radians(double degrees) {
     return degrees * M_PI / 180.;
 }
 
+// Finalizer of SplitMix64, a strong 64-bit bit mixer
+constexpr inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// SplitMix64 generator. Its state after n draws is start + n * GAMMA, which makes it
+// counter-based: seek() jumps straight to the stream of a (pixel, sample, bounce) key,
+// and the n-th draw on that stream is its n-th dimension. Renders therefore depend only
+// on the seed, never on tiling, thread count or scheduling order.
 struct RNG {
-    RNG() : generator() {}
-    RNG(uint_fast32_t seed) :generator(seed) {}
+    RNG() : RNG(0) {}
+    RNG(uint64_t seed) : m_seed(seed), m_state(mix64(seed)) {}
 
     RNG clone() {
+        return RNG(next_u64());
+    }
 
-        uint_fast32_t new_seed = uint_distribution(generator);
-        return RNG(new_seed);
-        // return RNG(uint_distribution(generator));
+    uint64_t next_u64() {
+        m_state += GAMMA;
+        return mix64(m_state);
     }
 
     double random_double() {
-        return double_distribution(generator);
+        return double(next_u64() >> 11) * 0x1.0p-53;
     }
     double random_double(double min, double max) {
         return min + (max - min) * random_double();
 
     }
 
-    std::mt19937 generator;
-    std::uniform_real_distribution<double> double_distribution{ 0.0, 1.0 };
-    std::uniform_int_distribution<uint_fast32_t> uint_distribution{
-        std::numeric_limits<uint_fast32_t>::min(),
-        std::numeric_limits<uint_fast32_t>::max()
-    };
+    // Uniform in [0, 1) at the build's precision. Rounding a double draw to float could
+    // return 1, so floats take their 24 mantissa bits straight from the generator.
+    // Under a low-discrepancy sampler (see use_sampler) the dimensions it covers come from
+    // the sampler instead, the hashed draw filling in a double's bits below its 32.
+    real random_real() {
+        const uint64_t bits = next_u64();
+        const uint32_t dimension = m_dimension++;
+        if (m_sampler != render::SamplerKind::Random && render::sampled_dimension(m_bounce, dimension)) {
+            // Dimensions come in pairs, both computed on the first draw of the pair
+            if (dimension / 2 != m_pair) {
+                m_pair = dimension / 2;
+                render::sample_pair(m_sampler, m_seed, m_pixel % m_width, m_pixel / m_width, m_sample, m_bounce, m_pair,
+                    m_pair_bits[0], m_pair_bits[1]);
+            }
+            const uint32_t sampled = m_pair_bits[dimension % 2];
+            if constexpr (std::is_same_v<real, float>) {
+                return float(sampled >> 8) * 0x1.0p-24f;
+            }
+            else {
+                return double((uint64_t(sampled) << 21) | (bits >> 43)) * 0x1.0p-53;
+            }
+        }
+        if constexpr (std::is_same_v<real, float>) {
+            return float(bits >> 40) * 0x1.0p-24f;
+        }
+        else {
+            return double(bits >> 11) * 0x1.0p-53;
+        }
+    }
+    real random_real(real min, real max) {
+        return min + (max - min) * random_real();
+    }
+
+    // Draws random_real's numbers from kind instead, for an image image_width pixels wide
+    // whose pixels seek() keys on y * image_width + x
+    void use_sampler(render::SamplerKind kind, uint32_t image_width) {
+        m_sampler = kind;
+        m_width = std::max(image_width, 1u);
+    }
+
+    void seek(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t dimension = 0) {
+        m_pixel = pixel;
+        m_sample = sample;
+        m_bounce = bounce;
+        m_dimension = dimension;
+        m_pair = NO_PAIR;
+        m_state = mix64(mix64(mix64(m_seed + pixel) + sample) + bounce) + uint64_t(dimension) * GAMMA;
+    }
+
+    // Moves to dimension 0 of the next bounce of the current sample
+    void next_bounce() {
+        seek(m_pixel, m_sample, m_bounce + 1);
+    }
+
+    // Moves to another dimension of the current bounce
+    void seek_dimension(uint32_t dimension) {
+        seek(m_pixel, m_sample, m_bounce, dimension);
+    }
+
+    uint64_t seed() const {
+        return m_seed;
+    }
+
+private:
+    static constexpr uint64_t GAMMA = 0x9e3779b97f4a7c15ULL;
+    static constexpr uint32_t NO_PAIR = ~0u;
+
+    uint64_t m_seed;
+    uint64_t m_state;
+    uint32_t m_pixel = 0, m_sample = 0, m_bounce = 0, m_dimension = 0;
+    render::SamplerKind m_sampler = render::SamplerKind::Random;
+    uint32_t m_width = 1;
+    uint32_t m_pair = NO_PAIR; // Pair of dimensions m_pair_bits holds
+    uint32_t m_pair_bits[2] = {};
 };
 
+inline real luminance(const color& c) {
+    return real(0.2126) * c.x + real(0.7152) * c.y + real(0.0722) * c.z;
+}
+
 inline vec3 random_vec3(RNG& rng) {
-    return vec3(rng.random_double(), rng.random_double(), rng.random_double());
+    return vec3(rng.random_real(), rng.random_real(), rng.random_real());
 }
 
-inline vec3 random_vec3(double min, double max, RNG& rng) {
-    return vec3(rng.random_double(min, max), rng.random_double(min, max), rng.random_double(min, max));
+inline vec3 random_vec3(real min, real max, RNG& rng) {
+    return vec3(rng.random_real(min, max), rng.random_real(min, max), rng.random_real(min, max));
 }
 
+// Uniform on the unit sphere from two numbers: z is uniform on [-1, 1] by Archimedes'
+// hat-box theorem. Mapping a fixed pair, rather than rejecting points of the cube, keeps
+// each bounce on the same dimensions for the low-discrepancy samplers.
 inline vec3 random_unit_vector(RNG& rng) {
-    auto p = random_vec3(-1., 1., rng);
-    while (glm::length2(p) > 1 || glm::length2(p) <= 1e-160) {
-        p = random_vec3(-1., 1., rng);
-    }
-    return p / glm::length(p);
+    const real z = 1 - 2 * rng.random_real();
+    const real phi = real(2 * M_PI) * rng.random_real();
+    const real r = std::sqrt(std::max(real(0), 1 - z * z));
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
 }
 
+// Uniform in the unit disk by Shirley and Chiu's concentric map of the square, which
+// keeps strata of the two numbers compact on the disk
 inline vec3 random_in_unit_disk(RNG& rng) {
-    while (true) {
-        auto p = vec3(rng.random_double(-1, 1), rng.random_double(-1, 1), 0);
-        if (glm::length2(p) < 1)
-            return p;
+    const real a = rng.random_real(-1, 1);
+    const real b = rng.random_real(-1, 1);
+    if (a == 0 && b == 0) {
+        return vec3(0, 0, 0);
     }
+    const real quarter = real(M_PI / 4);
+    const real r = std::abs(a) > std::abs(b) ? a : b;
+    const real theta = std::abs(a) > std::abs(b) ? quarter * (b / a) : 2 * quarter - quarter * (a / b);
+    return vec3(r * std::cos(theta), r * std::sin(theta), 0);
 }
 
 inline vec3 random_on_hemisphere(vec3 n, RNG& rng) {
@@ -81,18 +197,18 @@ inline vec3 reflect(const vec3 v, const vec3 n) {
     return v - 2 * glm::dot(v, n) * n;
 }
 
-inline vec3 refract(const vec3 uv, const vec3 n, double etai_over_etat) {
-    auto cos_theta = std::fmin(glm::dot(-uv, n), 1.0);
+inline vec3 refract(const vec3 uv, const vec3 n, real etai_over_etat) {
+    auto cos_theta = std::min(glm::dot(-uv, n), real(1));
     vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - glm::length2(r_out_perp))) * n;
+    vec3 r_out_parallel = -std::sqrt(std::abs(1 - glm::length2(r_out_perp))) * n;
     return r_out_perp + r_out_parallel;
 }
 
-inline vec3 offset(vec3 p, vec3 dir, double m) {
+inline vec3 offset(vec3 p, vec3 dir, real m) {
     return p + dir * m;
 }
 
-static double reflectance(double cosine, double refraction_index) {
+static real reflectance(real cosine, real refraction_index) {
     // Use Schlick's approximation for reflectance.
     auto r0 = (1 - refraction_index) / (1 + refraction_index);
     r0 = r0 * r0;
@@ -100,8 +216,8 @@ static double reflectance(double cosine, double refraction_index) {
 }
 
 inline bool near_zero(vec3 n) {
-    auto s = 1e-8;
-    return (std::fabs(n.x) < s) && (std::fabs(n.y) < s) && (std::fabs(n.z) < s);
+    const real s = 1e-8;
+    return (std::abs(n.x) < s) && (std::abs(n.y) < s) && (std::abs(n.z) < s);
 }
 
 inline void for2dTiled(int N, int M, int tileH, int tileW,
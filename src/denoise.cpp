@@ -0,0 +1,217 @@
+#include "denoise.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "aligned_allocator.h"
+
+namespace render {
+
+	namespace {
+		// Rows per task, each pass runs one task per band
+		constexpr int BAND_ROWS = 8;
+
+		// B3-spline weights of the 5x5 à-trous kernel along each axis
+		constexpr float KERNEL[5] = { 1.f / 16, 1.f / 4, 3.f / 8, 1.f / 4, 1.f / 16 };
+
+		// e^x for x <= 0, within 1e-5 relative, bottoming out at 2^-64 (about 5e-20) so
+		// weights and their products never turn denormal and slow every operation down.
+		// Plain float arithmetic and bit casts, with no float to int conversion the
+		// vectorizer has to keep behind a branch, so the loops calling it vectorize.
+		inline float exp_negative(float x) {
+			const float t = std::max(x * 1.44269504f, -64.f); // As a power of two
+			// Adding 1.5 * 2^23 rounds t to an integer held in the low mantissa bits
+			const float shifted = t + 12582912.f;
+			const float f = t - (shifted - 12582912.f); // In [-0.5, 0.5]
+			// 2^f by its Taylor series
+			const float p = 1.f + f * (0.693147181f + f * (0.240226507f + f * (0.0555041087f + f * (0.00961812911f + f * 0.00133335581f))));
+			int32_t bits;
+			std::memcpy(&bits, &shifted, sizeof(float));
+			bits = (bits - 0x4B400000 + 127) << 23;
+			float scale;
+			std::memcpy(&scale, &bits, sizeof(float));
+			return p * scale;
+		}
+
+		using Plane = aligned_vector<float>;
+
+		// The guide features in planes, read by every pass
+		struct Features {
+			Plane normal[3];
+			Plane albedo[3];
+			Plane depth;
+			Plane inv_depth; // Huge where the ray escaped, so no hit passes the depth test there
+		};
+
+		// Pixels of a row filtered together, their sums stay in a stack array
+		constexpr int SPAN = 64;
+
+		struct Pass {
+			int step;
+			float inv_color, inv_normal, inv_albedo; // 1 / sigma^2
+			float depth_sigma;
+		};
+
+		// Filters pixels [x0, x1) of row y of color into out. Taps outside the image are left
+		// out, the weight sum renormalizes. The sums live on the stack, where the compiler
+		// can tell they alias none of the planes, so each tap's loop vectorizes unversioned.
+		void filter_span(const Plane (&color)[3], Plane (&out)[3], const Features& features,
+			int width, int height, int y, int x0, int x1, const Pass& pass) {
+			float sum_r[SPAN] = {}, sum_g[SPAN] = {}, sum_b[SPAN] = {}, sum_w[SPAN] = {};
+			const size_t row = size_t(y) * size_t(width);
+			for (int ty = -2; ty <= 2; ++ty) {
+				const int qy = y + ty * pass.step;
+				if (qy < 0 || qy >= height) {
+					continue;
+				}
+				for (int tx = -2; tx <= 2; ++tx) {
+					const int dx = tx * pass.step;
+					const int x_begin = std::max(x0, -dx);
+					const int x_end = std::min(x1, width - dx);
+					if (x_begin >= x_end) {
+						continue;
+					}
+					const int count = x_end - x_begin;
+					const size_t p = row + size_t(x_begin);
+					const size_t q = size_t(qy) * size_t(width) + size_t(x_begin + dx);
+					const float kernel = KERNEL[ty + 2] * KERNEL[tx + 2];
+					// Depth may change in proportion to how far the tap is, as across a slope
+					const int distance = std::max(std::abs(tx), std::abs(ty)) * pass.step;
+					const float inv_depth_range = distance > 0 ? 1.f / (pass.depth_sigma * float(distance)) : 0.f;
+					const float inv_color = pass.inv_color, inv_normal = pass.inv_normal, inv_albedo = pass.inv_albedo;
+
+					const float* pr = color[0].data() + p;
+					const float* pg = color[1].data() + p;
+					const float* pb = color[2].data() + p;
+					const float* qr = color[0].data() + q;
+					const float* qg = color[1].data() + q;
+					const float* qb = color[2].data() + q;
+					const float* pnx = features.normal[0].data() + p;
+					const float* pny = features.normal[1].data() + p;
+					const float* pnz = features.normal[2].data() + p;
+					const float* qnx = features.normal[0].data() + q;
+					const float* qny = features.normal[1].data() + q;
+					const float* qnz = features.normal[2].data() + q;
+					const float* par = features.albedo[0].data() + p;
+					const float* pag = features.albedo[1].data() + p;
+					const float* pab = features.albedo[2].data() + p;
+					const float* qar = features.albedo[0].data() + q;
+					const float* qag = features.albedo[1].data() + q;
+					const float* qab = features.albedo[2].data() + q;
+					const float* pz = features.depth.data() + p;
+					const float* qz = features.depth.data() + q;
+					const float* p_inv_z = features.inv_depth.data() + p;
+					const int offset = x_begin - x0;
+					for (int k = 0; k < count; ++k) {
+						const float dr = pr[k] - qr[k], dg = pg[k] - qg[k], db = pb[k] - qb[k];
+						const float dnx = pnx[k] - qnx[k], dny = pny[k] - qny[k], dnz = pnz[k] - qnz[k];
+						const float dar = par[k] - qar[k], dag = pag[k] - qag[k], dab = pab[k] - qab[k];
+						const float exponent = (dr * dr + dg * dg + db * db) * inv_color
+							+ (dnx * dnx + dny * dny + dnz * dnz) * inv_normal
+							+ (dar * dar + dag * dag + dab * dab) * inv_albedo
+							+ std::abs(pz[k] - qz[k]) * p_inv_z[k] * inv_depth_range;
+						const float w = kernel * exp_negative(-exponent);
+						sum_r[offset + k] += w * qr[k];
+						sum_g[offset + k] += w * qg[k];
+						sum_b[offset + k] += w * qb[k];
+						sum_w[offset + k] += w;
+					}
+				}
+			}
+			// The centre tap always weighs in, so no sum is zero
+			for (int x = x0; x < x1; ++x) {
+				const float inv_weight = 1.f / sum_w[x - x0];
+				out[0][row + size_t(x)] = sum_r[x - x0] * inv_weight;
+				out[1][row + size_t(x)] = sum_g[x - x0] * inv_weight;
+				out[2][row + size_t(x)] = sum_b[x - x0] * inv_weight;
+			}
+		}
+	}
+
+	std::vector<float> denoise(const std::vector<float>& image, const AuxiliaryBuffers& auxiliary,
+		int width, int height, const DenoiseSettings& settings, ThreadPool& pool) {
+		const size_t pixels = size_t(width) * size_t(height);
+		if (image.size() != pixels * 3 || auxiliary.albedo.size() != pixels * 3
+			|| auxiliary.normal.size() != pixels * 3 || auxiliary.depth.size() != pixels) {
+			throw std::runtime_error("Denoising needs a color, albedo, normal and depth for every pixel");
+		}
+		const size_t bands = size_t((height + BAND_ROWS - 1) / BAND_ROWS);
+		const auto for_each_band = [&](auto&& visit) {
+			pool.parallel_for(bands, [&](size_t band) {
+				const int y_begin = int(band) * BAND_ROWS;
+				visit(y_begin, std::min(height, y_begin + BAND_ROWS));
+				});
+		};
+
+		Plane color[3], filtered[3];
+		Features features;
+		for (int c = 0; c < 3; ++c) {
+			color[c].resize(pixels);
+			filtered[c].resize(pixels);
+			features.normal[c].resize(pixels);
+			features.albedo[c].resize(pixels);
+		}
+		features.depth.resize(pixels);
+		features.inv_depth.resize(pixels);
+		for_each_band([&](int y_begin, int y_end) {
+			for (size_t p = size_t(y_begin) * width; p < size_t(y_end) * width; ++p) {
+				for (int c = 0; c < 3; ++c) {
+					color[c][p] = image[p * 3 + c];
+					features.normal[c][p] = auxiliary.normal[p * 3 + c];
+					features.albedo[c][p] = auxiliary.albedo[p * 3 + c];
+				}
+				const float depth = auxiliary.depth[p];
+				features.depth[p] = depth;
+				features.inv_depth[p] = depth > 0.f ? 1.f / depth : 1e6f;
+			}
+			});
+
+		for (int iteration = 0; iteration < settings.iterations; ++iteration) {
+			Pass pass;
+			pass.step = 1 << iteration;
+			const float color_sigma = settings.color_sigma / float(pass.step);
+			pass.inv_color = 1.f / (color_sigma * color_sigma);
+			pass.inv_normal = 1.f / (settings.normal_sigma * settings.normal_sigma);
+			pass.inv_albedo = 1.f / (settings.albedo_sigma * settings.albedo_sigma);
+			pass.depth_sigma = settings.depth_sigma;
+			for_each_band([&](int y_begin, int y_end) {
+				for (int y = y_begin; y < y_end; ++y) {
+					for (int x0 = 0; x0 < width; x0 += SPAN) {
+						filter_span(color, filtered, features, width, height, y, x0, std::min(width, x0 + SPAN), pass);
+					}
+				}
+				});
+			std::swap(color, filtered);
+		}
+
+		std::vector<float> out(pixels * 3);
+		for_each_band([&](int y_begin, int y_end) {
+			for (size_t p = size_t(y_begin) * width; p < size_t(y_end) * width; ++p) {
+				for (int c = 0; c < 3; ++c) {
+					out[p * 3 + c] = color[c][p];
+				}
+			}
+			});
+		return out;
+	}
+
+	ImageError compare_images(const std::vector<float>& image, const std::vector<float>& reference) {
+		if (image.size() != reference.size() || image.empty()) {
+			throw std::runtime_error("Compared images differ in size");
+		}
+		double squared = 0., relative = 0.;
+		for (size_t i = 0; i < image.size(); ++i) {
+			const double difference = double(image[i]) - double(reference[i]);
+			squared += difference * difference;
+			relative += difference * difference / (double(reference[i]) * double(reference[i]) + 0.01);
+		}
+		const double n = double(image.size());
+		ImageError error;
+		error.rmse = std::sqrt(squared / n);
+		error.rel_mse = relative / n;
+		error.psnr = 10. * std::log10(1. / std::max(squared / n, 1e-20));
+		return error;
+	}
+
+}
@@ -0,0 +1,45 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include <vector>
+#include "render_stats.h"
+#include "thread_pool.h"
+
+namespace render {
+
+    // First-hit features of a frame, averaged over each pixel's samples. Rows run top to
+    // bottom like the image, with three floats per pixel for albedo and normal and one
+    // for depth. Rays that escape count the background as their albedo.
+    struct AuxiliaryBuffers {
+        std::vector<float> albedo; // Material::albedo of the surface seen first
+        std::vector<float> normal; // HitRecord::normal, facing the camera, zero for escaped rays
+        std::vector<float> depth; // Distance from the camera, zero for escaped rays
+    };
+
+    // Edge-stopping weights of the filter, each the width of the Gaussian falloff over the
+    // difference of one feature between two pixels. The defaults scored best against a
+    // 512 spp reference of the main scene from 4 to 64 spp; its defocus and motion blur
+    // leave the features noisy too, so they are not trusted too far.
+    struct DenoiseSettings {
+        int iterations = 3; // Pass i spaces its 5x5 taps 2^i pixels apart
+        float color_sigma = 0.5f; // Halved every pass, as the color gets smoother
+        float normal_sigma = 1.f;
+        float albedo_sigma = 1.f;
+        float depth_sigma = 1.f; // Relative to the pixel's depth, per pixel of tap distance
+    };
+
+    // Edge-avoiding à-trous wavelet filter (Dammertz et al., HPG 2010): repeated 5x5
+    // B-spline smoothing with ever wider gaps between the taps, each tap weighted down by
+    // how much its color, normal, albedo and depth differ from the pixel's. Noise within
+    // a surface is averaged away while silhouettes and material edges stay sharp.
+    // image is width * height RGB floats, rows top to bottom. Each pass runs over bands
+    // of rows on pool, on planar copies of the channels so the inner loop vectorizes.
+    std::vector<float> denoise(const std::vector<float>& image, const AuxiliaryBuffers& auxiliary,
+        int width, int height, const DenoiseSettings& settings, ThreadPool& pool);
+
+    // Error of an image against a reference of the same size, e.g. a high-spp render of
+    // the same view. Throws std::runtime_error when the sizes differ.
+    ImageError compare_images(const std::vector<float>& image, const std::vector<float>& reference);
+
+}
+#endif // DENOISE_H
@@ -3,20 +3,27 @@
 #include <cassert>
 #include <stdexcept>
 #include <memory>
+#include <ostream>
+#include <string>
+#include <typeinfo>
 #include "entity.h"
 #include "component.h"
 #include "system.h"
 
-// TODO: Create const getters for read-only systems
-
 class ECS {
 public:
     ECS() : m_entityManager(), m_componentManager(), m_systemManager() {};
     Entity createEntity() {
         return m_entityManager.createEntity();
     }
+    // Creates count entities with consecutive ids and returns the first, for filling with
+    // addComponents
+    Entity createEntities(Entity count) {
+        return m_entityManager.createEntities(count);
+    }
     void destroyEntity(Entity entity) {
         m_entityManager.destroyEntity(entity);
+        m_componentManager.updateGroups(entity, Signature{});
         m_componentManager.entityDestroyed(entity);
         m_systemManager.entityDestroyed(entity);
     }
@@ -25,6 +32,10 @@ public:
         m_componentManager.registerComponent<T>();
     }
     template <typename T>
+    bool isRegistered() const {
+        return m_componentManager.isRegistered<T>();
+    }
+    template <typename T>
     void addComponent(Entity entity, T component) {
         m_componentManager.addComponent<T>(entity, component);
 
@@ -32,14 +43,37 @@ public:
         signature.set(m_componentManager.getComponentType<T>(),
             true);
         m_entityManager.setSignature(entity, signature);
+        m_componentManager.updateGroups(entity, signature);
         m_systemManager.EntitySignatureChanged(entity, m_entityManager.getSignature(entity));
     }
 
+    // Adds components[i] to entity first + i for every i in [0, count), with the same
+    // result as count addComponent calls. The entities must share one signature, as
+    // fresh ones from createEntities do, so group and system membership is worked out
+    // once for the whole range.
+    template <typename T>
+    void addComponents(Entity first, Entity count, const T* components) {
+        if (count == 0) {
+            return;
+        }
+        const Signature old_signature = m_entityManager.getSignature(first);
+        Signature signature = old_signature;
+        signature.set(m_componentManager.getComponentType<T>(), true);
+        for (Entity entity = first; entity < first + count; ++entity) {
+            assert(m_entityManager.getSignature(entity) == old_signature && "Entities in a range must share their signature.");
+            m_entityManager.setSignature(entity, signature);
+        }
+        m_componentManager.addComponents<T>(first, count, components);
+        m_componentManager.updateGroups(first, count, old_signature, signature);
+        m_systemManager.entitiesSignatureChanged(first, count, signature);
+    }
+
     template <typename T>
     void removeComponent(Entity entity) {
-        m_componentManager.removeComponent<T>(entity);
         auto signature = m_entityManager.getSignature(entity);
         signature.set(m_componentManager.getComponentType<T>(), false);
+        m_componentManager.updateGroups(entity, signature);
+        m_componentManager.removeComponent<T>(entity);
         m_entityManager.setSignature(entity, signature);
         m_systemManager.EntitySignatureChanged(entity, m_entityManager.getSignature(entity));
     }
@@ -52,17 +86,63 @@ public:
         return m_componentManager.getComponent<T>(entity);
     }
     template <typename T>
+    bool hasComponent(Entity entity) const {
+        return m_componentManager.hasComponent<T>(entity);
+    }
+    // Keeps entities holding all of Ts packed together so view<Ts...>() can walk them in
+    // lockstep. Register groups before the hot loops that use them.
+    template <typename... Ts>
+    void registerGroup() {
+        m_componentManager.registerGroup<Ts...>();
+    }
+    template <typename... Ts>
+    View<Ts...> view() {
+        return m_componentManager.view<Ts...>();
+    }
+    template <typename... Ts>
+    View<const Ts...> view() const {
+        return m_componentManager.view<Ts...>();
+    }
+    // Visits every T as fn(entity, component) in storage order
+    template <typename T, typename Fn>
+    void forEach(Fn&& fn) {
+        m_componentManager.forEach<T>(std::forward<Fn>(fn));
+    }
+    template <typename T, typename Fn>
+    void forEach(Fn&& fn) const {
+        m_componentManager.forEach<T>(std::forward<Fn>(fn));
+    }
+    template <typename T>
     ComponentType getComponentType() {
         return m_componentManager.getComponentType<T>();
     }
+    template <typename... Ts>
+    Signature componentSignature() {
+        Signature signature;
+        (signature.set(m_componentManager.getComponentType<Ts>()), ...);
+        return signature;
+    }
+    // name labels the system in the timing report
     template <typename T>
-    T& registerSystem() {
-        return m_systemManager.registerSystem<T>();
+    T& registerSystem(std::string name = typeid(T).name()) {
+        return m_systemManager.registerSystem<T>(std::move(name));
     }
     template <typename T>
     void setSystemSignature(Signature signature) {
         m_systemManager.setSignature<T>(signature);
     }
+    // Component types T reads and writes in update, used to run systems concurrently
+    template <typename T>
+    void setSystemAccess(Signature reads, Signature writes) {
+        m_systemManager.setAccess<T>(reads, writes);
+    }
+    // Runs every system's update, non-conflicting systems in parallel on pool
+    void update(ThreadPool& pool) {
+        m_systemManager.update(*this, pool);
+    }
+    void reportSystemTimings(std::ostream& out) const {
+        m_systemManager.reportTimings(out);
+    }
 
 private:
     EntityManager m_entityManager; // Manages entities
@@ -0,0 +1,130 @@
+#ifndef CHUNKED_STORAGE_H
+#define CHUNKED_STORAGE_H
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "entity.h"
+
+// Array that grows one fixed-size chunk at a time. Elements never move once stored, so
+// pointers into a chunk stay valid as the array grows, and each chunk is contiguous.
+template <typename T, size_t ChunkSize = 1024>
+class ChunkedVector {
+public:
+    static constexpr size_t CHUNK_SIZE = ChunkSize;
+
+    void push_back(T value) {
+        if (m_size == m_chunks.size() * ChunkSize) {
+            m_chunks.push_back(std::make_unique<T[]>(ChunkSize));
+        }
+        (*this)[m_size++] = std::move(value);
+    }
+
+    // Appends values[0, count), copied a chunk at a time
+    void append(const T* values, size_t count) {
+        while (count > 0) {
+            if (m_size == m_chunks.size() * ChunkSize) {
+                m_chunks.push_back(std::make_unique<T[]>(ChunkSize));
+            }
+            const size_t offset = m_size % ChunkSize;
+            const size_t n = std::min(count, ChunkSize - offset);
+            std::copy_n(values, n, m_chunks[m_size / ChunkSize].get() + offset);
+            m_size += n;
+            values += n;
+            count -= n;
+        }
+    }
+
+    void pop_back() {
+        assert(m_size > 0 && "pop_back on empty ChunkedVector.");
+        (*this)[--m_size] = T();
+    }
+
+    T& operator[](size_t index) {
+        return m_chunks[index / ChunkSize][index % ChunkSize];
+    }
+    const T& operator[](size_t index) const {
+        return m_chunks[index / ChunkSize][index % ChunkSize];
+    }
+
+    T& back() {
+        return (*this)[m_size - 1];
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    // Chunks holding at least one element. Chunk i holds chunkSize(i) contiguous elements.
+    size_t chunkCount() const {
+        return (m_size + ChunkSize - 1) / ChunkSize;
+    }
+    size_t chunkSize(size_t chunk) const {
+        return std::min(ChunkSize, m_size - chunk * ChunkSize);
+    }
+    T* chunk(size_t chunk) {
+        return m_chunks[chunk].get();
+    }
+    const T* chunk(size_t chunk) const {
+        return m_chunks[chunk].get();
+    }
+
+private:
+    std::vector<std::unique_ptr<T[]>> m_chunks;
+    size_t m_size = 0;
+};
+
+// Entity -> dense index map split into pages that are only allocated once an entity in
+// their range is stored, so memory follows the ids in use rather than the largest id.
+class SparsePages {
+public:
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    Entity get(Entity entity) const {
+        const size_t page = entity / PAGE_SIZE;
+        if (page >= m_pages.size() || !m_pages[page]) {
+            return INVALID;
+        }
+        return m_pages[page][entity % PAGE_SIZE];
+    }
+
+    void set(Entity entity, Entity index) {
+        const size_t page = entity / PAGE_SIZE;
+        if (page >= m_pages.size()) {
+            m_pages.resize(page + 1);
+        }
+        if (!m_pages[page]) {
+            m_pages[page] = std::make_unique<Entity[]>(PAGE_SIZE);
+            std::fill_n(m_pages[page].get(), PAGE_SIZE, INVALID);
+        }
+        m_pages[page][entity % PAGE_SIZE] = index;
+    }
+
+    // Maps entity first + i to index + i for every i in [0, count)
+    void setRange(Entity first, Entity count, Entity index) {
+        while (count > 0) {
+            const size_t page = first / PAGE_SIZE;
+            const Entity offset = first % PAGE_SIZE;
+            const Entity n = std::min<Entity>(count, Entity(PAGE_SIZE - offset));
+            if (page >= m_pages.size()) {
+                m_pages.resize(page + 1);
+            }
+            if (!m_pages[page]) {
+                m_pages[page] = std::make_unique<Entity[]>(PAGE_SIZE);
+                std::fill_n(m_pages[page].get(), PAGE_SIZE, INVALID);
+            }
+            for (Entity i = 0; i < n; ++i) {
+                m_pages[page][offset + i] = index + i;
+            }
+            first += n;
+            index += n;
+            count -= n;
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<Entity[]>> m_pages;
+};
+
+#endif // CHUNKED_STORAGE_H
@@ -1,7 +1,13 @@
 #ifndef COMPONENT_H
 #define COMPONENT_H
 
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <vector>
+#include "chunked_storage.h"
 #include "entity.h"
+#include "view.h"
 
 inline ComponentType nextComponentID = 0;
 
@@ -9,47 +15,67 @@ class IComponentArray {
 public:
     virtual ~IComponentArray() = default;
     virtual void EntityDestroyed(Entity entity) = 0; // Remove component from entity
-
+    virtual bool contains(Entity entity) const = 0;
+    virtual Entity indexOf(Entity entity) const = 0; // Slot of the entity's component
+    virtual void swapIndices(Entity a, Entity b) = 0; // Swaps the components in two slots
+    // Whether slots [index, index + count) hold the components of entities first,
+    // first + 1, ..., first + count - 1 in that order
+    virtual bool holdsRange(Entity index, Entity first, Entity count) const = 0;
 };
 
 template <typename T>
 class ComponentArray : public IComponentArray {
 public:
+    static constexpr size_t CHUNK_SIZE = ChunkedVector<T>::CHUNK_SIZE;
 
-    ComponentArray() {
-        m_sparse.fill(INVALID);
-    }
-
-    bool hasComponent(Entity entity) {
-        return m_sparse[entity] != INVALID;
+    bool hasComponent(Entity entity) const {
+        return m_sparse.get(entity) != INVALID;
     }
 
     void insertData(Entity entity, T component) {
         assert(!hasComponent(entity) && "Component added to same entity more than once.");
-        m_componentArray[m_size] = component;
-        m_sparse[entity] = m_size;
-        m_dense[m_size] = entity;
-        ++m_size;
+        m_sparse.set(entity, Entity(m_dense.size()));
+        m_dense.push_back(entity);
+        m_componentArray.push_back(component);
+    }
+
+    // Appends components[i] for entity first + i
+    void insertRange(Entity first, Entity count, const T* components) {
+#ifndef NDEBUG
+        for (Entity entity = first; entity < first + count; ++entity) {
+            assert(!hasComponent(entity) && "Component added to same entity more than once.");
+        }
+#endif
+        const Entity index = Entity(m_dense.size());
+        m_sparse.setRange(first, count, index);
+        m_dense.resize(m_dense.size() + count);
+        std::iota(m_dense.begin() + index, m_dense.end(), first);
+        m_componentArray.append(components, count);
     }
 
     void removeData(Entity entity) {
         assert(hasComponent(entity) && "Removing non-existent component.");
-        size_t index = m_sparse[entity];
-        size_t lastIndex = m_size - 1;
+        const Entity index = m_sparse.get(entity);
+        const Entity lastIndex = Entity(m_dense.size() - 1);
         if (index != lastIndex) {
             // Move the last element to the index of the removed element
             m_dense[index] = m_dense[lastIndex];
-            m_sparse[m_dense[index]] = index;
+            m_sparse.set(m_dense[index], index);
             m_componentArray[index] = m_componentArray[lastIndex];
         }
-        m_componentArray[index] = T(); // Reset the component
-        m_sparse[index] = INVALID;
-        --m_size;
+        m_componentArray.pop_back(); // Resets the vacated last slot
+        m_dense.pop_back();
+        m_sparse.set(entity, INVALID);
     }
 
     T& getData(Entity entity) {
         assert(hasComponent(entity) && "Component not found for entity.");
-        return m_componentArray[m_sparse[entity]];
+        return m_componentArray[m_sparse.get(entity)];
+    }
+
+    const T& getData(Entity entity) const {
+        assert(hasComponent(entity) && "Component not found for entity.");
+        return m_componentArray[m_sparse.get(entity)];
     }
 
     void EntityDestroyed(Entity entity) override {
@@ -58,15 +84,81 @@ public:
         }
     }
 
-    size_t size() {
-        return m_size;
+    bool contains(Entity entity) const override {
+        return hasComponent(entity);
+    }
+
+    Entity indexOf(Entity entity) const override {
+        assert(hasComponent(entity) && "Component not found for entity.");
+        return m_sparse.get(entity);
+    }
+
+    void swapIndices(Entity a, Entity b) override {
+        if (a == b) {
+            return;
+        }
+        std::swap(m_componentArray[a], m_componentArray[b]);
+        std::swap(m_dense[a], m_dense[b]);
+        m_sparse.set(m_dense[a], a);
+        m_sparse.set(m_dense[b], b);
+    }
+
+    bool holdsRange(Entity index, Entity first, Entity count) const override {
+        if (size_t(index) + count > m_dense.size()) {
+            return false;
+        }
+        for (Entity i = 0; i < count; ++i) {
+            if (m_dense[index + i] != first + i) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Entity owning the component in each slot
+    const std::vector<Entity>& entities() const {
+        return m_dense;
+    }
+
+    T* chunk(size_t chunk) {
+        return m_componentArray.chunk(chunk);
+    }
+    const T* chunk(size_t chunk) const {
+        return m_componentArray.chunk(chunk);
+    }
+
+    size_t size() const {
+        return m_dense.size();
+    }
+
+    // Visits every component as fn(entity, component), one contiguous chunk at a time
+    template <typename Fn>
+    void forEach(Fn&& fn) {
+        size_t index = 0;
+        for (size_t chunk = 0; chunk < m_componentArray.chunkCount(); ++chunk) {
+            T* components = m_componentArray.chunk(chunk);
+            const size_t count = m_componentArray.chunkSize(chunk);
+            for (size_t i = 0; i < count; ++i, ++index) {
+                fn(m_dense[index], components[i]);
+            }
+        }
+    }
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        size_t index = 0;
+        for (size_t chunk = 0; chunk < m_componentArray.chunkCount(); ++chunk) {
+            const T* components = m_componentArray.chunk(chunk);
+            const size_t count = m_componentArray.chunkSize(chunk);
+            for (size_t i = 0; i < count; ++i, ++index) {
+                fn(m_dense[index], components[i]);
+            }
+        }
     }
 
 private:
-    std::array<T, MAX_ENTITIES> m_componentArray; // Array of components
-    std::array<Entity, MAX_ENTITIES> m_dense{};
-    std::array<size_t, MAX_ENTITIES> m_sparse{}; // maps entity -> index in dense
-    size_t m_size = 0; // Current size of the component array
+    ChunkedVector<T> m_componentArray; // Components, packed in insertion order
+    std::vector<Entity> m_dense; // Entity owning each component
+    SparsePages m_sparse; // maps entity -> index in dense
 };
 
 class ComponentManager {
@@ -90,17 +182,121 @@ public:
         return typeID;
     }
 
+    // Owns the arrays of Ts so entities holding all of them stay packed at the front.
+    // A component type can belong to one group only.
+    template <typename... Ts>
+    void registerGroup() {
+        static_assert(sizeof...(Ts) >= 2, "A group joins at least two components.");
+        assert((isRegistered<Ts>() && ...) && "Component not registered.");
+        Group group;
+        (group.mask.set(getComponentType<Ts>()), ...);
+        (group.types.push_back(getComponentType<Ts>()), ...);
+        for (const ComponentType type : group.types) {
+            assert(!m_groupOwned.test(type) && "Component already owned by another group.");
+            m_groupOwned.set(type);
+        }
+        m_groups.push_back(group);
+
+        // Pack the entities that already hold every component
+        // Copied since packing reorders the array being walked
+        const std::vector<Entity> candidates = getComponentArray<std::tuple_element_t<0, std::tuple<Ts...>>>().entities();
+        for (const Entity entity : candidates) {
+            if ((m_componentArrays[getComponentType<Ts>()]->contains(entity) && ...)) {
+                pack(m_groups.back(), entity);
+            }
+        }
+    }
+
+    // Moves the entity into or out of every group so membership matches the components
+    // in signature. Called after a component is added and before one is removed.
+    void updateGroups(Entity entity, Signature signature) {
+        for (Group& group : m_groups) {
+            const bool member = inGroup(group, entity);
+            const bool complete = (signature & group.mask) == group.mask;
+            if (complete && !member) {
+                pack(group, entity);
+            }
+            else if (!complete && member) {
+                unpack(group, entity);
+            }
+        }
+    }
+
+    // updateGroups for entities first, ..., first + count - 1, which all had old_signature
+    // and now have signature. Entities that were appended in order right behind a group's
+    // members join it without being swapped into place one by one.
+    void updateGroups(Entity first, Entity count, Signature old_signature, Signature signature) {
+        for (Group& group : m_groups) {
+            const bool was_complete = (old_signature & group.mask) == group.mask;
+            const bool complete = (signature & group.mask) == group.mask;
+            if (complete == was_complete) {
+                continue;
+            }
+            if (complete && std::all_of(group.types.begin(), group.types.end(), [&](ComponentType type) {
+                return m_componentArrays[type]->holdsRange(group.size, first, count);
+                })) {
+                group.size += count;
+                continue;
+            }
+            for (Entity entity = first; entity < first + count; ++entity) {
+                if (complete) {
+                    pack(group, entity);
+                }
+                else {
+                    unpack(group, entity);
+                }
+            }
+        }
+    }
+
+    template <typename... Ts>
+    View<Ts...> view() {
+        const Group& group = findGroup<Ts...>();
+        return View<Ts...>(group.size, &getComponentArray<Ts>()...);
+    }
+
+    template <typename... Ts>
+    View<const Ts...> view() const {
+        const Group& group = findGroup<Ts...>();
+        return View<const Ts...>(group.size, &getComponentArray<Ts>()...);
+    }
+
     template <typename T>
     T& getComponent(Entity entity) {
         assert(isRegistered<T>() && "Component not registered.");
         return getComponentArray<T>().getData(entity);
     }
 
+    template <typename T>
+    const T& getComponent(Entity entity) const {
+        assert(isRegistered<T>() && "Component not registered.");
+        return getComponentArray<T>().getData(entity);
+    }
+
+    template <typename T>
+    bool hasComponent(Entity entity) const {
+        return getComponentArray<T>().hasComponent(entity);
+    }
+
+    template <typename T, typename Fn>
+    void forEach(Fn&& fn) {
+        getComponentArray<T>().forEach(std::forward<Fn>(fn));
+    }
+    template <typename T, typename Fn>
+    void forEach(Fn&& fn) const {
+        getComponentArray<T>().forEach(std::forward<Fn>(fn));
+    }
+
     template <typename T>
     void addComponent(Entity entity, T component) {
         getComponentArray<T>().insertData(entity, component);
     }
 
+    template <typename T>
+    void addComponents(Entity first, Entity count, const T* components) {
+        getComponentArray<T>().insertRange(first, count, components);
+    }
+
     template <typename T>
     void removeComponent(Entity entity) {
         getComponentArray<T>().removeData(entity);
@@ -108,7 +304,9 @@ public:
 
     void entityDestroyed(Entity entity) {
         for (auto& compArray : m_componentArrays) {
-            compArray->EntityDestroyed(entity);
+            if (compArray) {
+                compArray->EntityDestroyed(entity);
+            }
         }
     }
 
@@ -118,7 +316,51 @@ private:
         assert(isRegistered<T>() && "Component not registered.");
         return *(static_cast<ComponentArray<T>*>(m_componentArrays[getComponentType<T>()].get()));
     }
+    template <typename T>
+    const ComponentArray<T>& getComponentArray() const {
+        assert(isRegistered<T>() && "Component not registered.");
+        return *(static_cast<const ComponentArray<T>*>(m_componentArrays[getComponentType<T>()].get()));
+    }
+    struct Group {
+        Signature mask;
+        std::vector<ComponentType> types;
+        Entity size = 0; // Members occupy slots [0, size) of every owned array
+    };
+
+    template <typename... Ts>
+    const Group& findGroup() const {
+        Signature mask;
+        (mask.set(getComponentType<Ts>()), ...);
+        const auto group = std::find_if(m_groups.begin(), m_groups.end(),
+            [&](const Group& g) { return g.mask == mask; });
+        assert(group != m_groups.end() && "No group registered for these components.");
+        return *group;
+    }
+
+    bool inGroup(const Group& group, Entity entity) const {
+        const IComponentArray& first = *m_componentArrays[group.types[0]];
+        return first.contains(entity) && first.indexOf(entity) < group.size;
+    }
+
+    void pack(Group& group, Entity entity) {
+        for (const ComponentType type : group.types) {
+            IComponentArray& array = *m_componentArrays[type];
+            array.swapIndices(array.indexOf(entity), group.size);
+        }
+        ++group.size;
+    }
+
+    void unpack(Group& group, Entity entity) {
+        --group.size;
+        for (const ComponentType type : group.types) {
+            IComponentArray& array = *m_componentArrays[type];
+            array.swapIndices(array.indexOf(entity), group.size);
+        }
+    }
+
     std::array<std::unique_ptr<IComponentArray>, MAX_COMPONENTS> m_componentArrays{}; // Maps component ID to its array
+    std::vector<Group> m_groups;
+    Signature m_groupOwned; // Component types owned by a group
 };
 
 #endif
\ No newline at end of file
@@ -1,8 +1,11 @@
 #ifndef ENTITY_H
 #define ENTITY_H
 #include <cstdint>
+#include <limits>
 #include <queue>
+#include <stdexcept>
 #include <array>
+#include <vector>
 #include <bitset>
 
 using Entity = uint32_t;
@@ -12,51 +15,70 @@ const ComponentType MAX_COMPONENTS = 32;
 using Signature = std::bitset<MAX_COMPONENTS>;
 
 
-// Used to define the size of arrays later on
-constexpr Entity MAX_ENTITIES = 5000;
+// Entity ids stay below MAX_ENTITIES, storage for them grows on demand
 constexpr Entity INVALID = std::numeric_limits<Entity>::max();
+constexpr Entity MAX_ENTITIES = INVALID;
 
 
 class EntityManager {
 public:
-    EntityManager() {
-        for (Entity i = 0; i < MAX_ENTITIES; ++i) {
-            m_availableEntities.push(i);
+    Entity createEntity() {
+        Entity entity;
+        if (!m_availableEntities.empty()) {
+            entity = m_availableEntities.front();
+            m_availableEntities.pop();
+        }
+        else {
+            if (m_nextEntity >= MAX_ENTITIES) {
+                throw std::runtime_error("No available entities");
+            }
+            entity = m_nextEntity++;
+            m_signatures.emplace_back();
         }
+        return entity;
     }
 
-    Entity createEntity() {
-        if (m_availableEntities.empty()) {
+    // Creates count entities with consecutive ids, never recycled ones, and returns the first
+    Entity createEntities(Entity count) {
+        if (count > MAX_ENTITIES - m_nextEntity) {
             throw std::runtime_error("No available entities");
         }
-        Entity entity = m_availableEntities.front();
-        m_availableEntities.pop();
-        return entity;
+        const Entity first = m_nextEntity;
+        m_nextEntity += count;
+        m_signatures.resize(m_nextEntity);
+        return first;
     }
 
     void destroyEntity(Entity entity) {
-        if (entity >= MAX_ENTITIES) {
+        if (entity >= m_nextEntity) {
             throw std::out_of_range("Entity out of range");
         }
+        m_signatures[entity].reset();
         m_availableEntities.push(entity);
     }
 
     void setSignature(Entity entity, Signature signature) {
-        if (entity >= MAX_ENTITIES) {
+        if (entity >= m_nextEntity) {
             throw std::out_of_range("Entity out of range");
         }
         m_signatures[entity] = signature;
     }
     Signature getSignature(Entity entity) const {
-        if (entity >= MAX_ENTITIES) {
+        if (entity >= m_nextEntity) {
             throw std::out_of_range("Entity out of range");
         }
         return m_signatures[entity];
     }
 
+    // Ids handed out so far, live or recycled
+    Entity capacity() const {
+        return m_nextEntity;
+    }
+
 private:
-    std::queue<Entity> m_availableEntities; // Queue of available entities
-    std::array<Signature, MAX_ENTITIES> m_signatures; // Signatures for each entity
+    std::queue<Entity> m_availableEntities; // Destroyed entities waiting to be reused
+    std::vector<Signature> m_signatures; // Signatures for each entity
+    Entity m_nextEntity = 0; // First id never handed out
 };
 
 
@@ -0,0 +1,111 @@
+#ifndef ENTITY_SET_H
+#define ENTITY_SET_H
+#include <cassert>
+#include <vector>
+#include "entity.h"
+
+// Sparse set of entities: m_sparse maps an entity to its position in m_dense, so insert,
+// erase and contains are O(1) and iteration walks one contiguous array.
+// Erasing normally moves the last entity into the hole, which reorders the set. With stable
+// order the tail is shifted down instead, keeping insertion order at O(n) per erase.
+class EntitySet {
+public:
+    using const_iterator = std::vector<Entity>::const_iterator;
+
+    EntitySet() = default;
+    explicit EntitySet(bool stable_order) : m_stableOrder(stable_order) {}
+
+    bool contains(Entity entity) const {
+        return entity < m_sparse.size() && m_sparse[entity] != INVALID;
+    }
+
+    // Returns false if the entity was already in the set
+    bool insert(Entity entity) {
+        if (contains(entity)) {
+            return false;
+        }
+        if (entity >= m_sparse.size()) {
+            m_sparse.resize(size_t(entity) + 1, INVALID);
+        }
+        m_sparse[entity] = Entity(m_dense.size());
+        m_dense.push_back(entity);
+        return true;
+    }
+
+    // Inserts first, first + 1, ..., first + count - 1, skipping members
+    void insertRange(Entity first, Entity count) {
+        if (size_t(first) + count > m_sparse.size()) {
+            m_sparse.resize(size_t(first) + count, INVALID);
+        }
+        m_dense.reserve(m_dense.size() + count);
+        for (Entity entity = first; entity < first + count; ++entity) {
+            if (m_sparse[entity] == INVALID) {
+                m_sparse[entity] = Entity(m_dense.size());
+                m_dense.push_back(entity);
+            }
+        }
+    }
+
+    // Returns false if the entity was not in the set
+    bool erase(Entity entity) {
+        if (!contains(entity)) {
+            return false;
+        }
+        const Entity index = m_sparse[entity];
+        if (m_stableOrder) {
+            for (size_t i = index + 1; i < m_dense.size(); ++i) {
+                m_dense[i - 1] = m_dense[i];
+                m_sparse[m_dense[i - 1]] = Entity(i - 1);
+            }
+        }
+        else {
+            m_dense[index] = m_dense.back();
+            m_sparse[m_dense[index]] = index;
+        }
+        m_dense.pop_back();
+        m_sparse[entity] = INVALID;
+        return true;
+    }
+
+    void clear() {
+        for (const Entity entity : m_dense) {
+            m_sparse[entity] = INVALID;
+        }
+        m_dense.clear();
+    }
+
+    void reserve(size_t n) {
+        m_dense.reserve(n);
+    }
+
+    bool stable_order() const {
+        return m_stableOrder;
+    }
+
+    size_t size() const {
+        return m_dense.size();
+    }
+    bool empty() const {
+        return m_dense.empty();
+    }
+    const Entity* data() const {
+        return m_dense.data();
+    }
+    Entity operator[](size_t index) const {
+        assert(index < m_dense.size() && "EntitySet index out of range.");
+        return m_dense[index];
+    }
+    const_iterator begin() const {
+        return m_dense.begin();
+    }
+    const_iterator end() const {
+        return m_dense.end();
+    }
+
+private:
+    std::vector<Entity> m_dense; // Members, contiguous
+    std::vector<Entity> m_sparse; // Maps entity -> index in m_dense, INVALID when absent
+    bool m_stableOrder = false;
+};
+
+#endif // ENTITY_SET_H
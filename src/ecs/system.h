@@ -1,17 +1,59 @@
 #ifndef SYSTEM_H
 #define SYSTEM_H
-#include <set>
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
 #include "entity.h"
+#include "entity_set.h"
+#include "../thread_pool.h"
 
 using SystemType = std::uint8_t;
 inline SystemType nextSystemID = 0;
 const SystemType MAX_SYSTEMS = 32;
 
+class ECS;
+
 
 class System {
 public:
-    std::set<Entity> entities; // Set of entities that this system operates on
+    System() = default;
+    // Systems that need their entities in insertion order pass stable_order = true
+    explicit System(bool stable_order) : entities(stable_order) {}
+    virtual ~System() = default;
+
+    // Called once per ECS::update. Systems may run concurrently with any system whose
+    // declared access does not conflict, so update must only touch the components it
+    // declared and must not add or remove components or entities.
+    virtual void update(ECS&) {}
+
+    EntitySet entities; // Set of entities that this system operates on
+};
+
+// Component types a system reads and writes during update. Two systems conflict when one
+// writes a type the other reads or writes. A system that never declared its access
+// conflicts with every other system.
+struct SystemAccess {
+    Signature reads;
+    Signature writes;
+    bool declared = false;
+
+    bool conflictsWith(const SystemAccess& other) const {
+        if (!declared || !other.declared) {
+            return true;
+        }
+        return (writes & (other.reads | other.writes)).any() || (other.writes & reads).any();
+    }
+};
+
+struct SystemTiming {
+    std::string name;
+    double last_ms = 0.;
+    double total_ms = 0.;
+    uint64_t runs = 0;
 };
 
 
@@ -30,11 +72,49 @@ public:
     }
 
     template <typename T>
-    T& registerSystem() {
+    T& registerSystem(std::string name = typeid(T).name()) {
         assert(!isRegistered<T>() && "System already registered.");
         assert(getSystemType<T>() < m_systems.size() && "Max number of systems reached.");
-        m_systems[getSystemType<T>()] = std::make_unique<T>();
-        return *(static_cast<T*>(m_systems[getSystemType<T>()].get()));
+        const SystemType type = getSystemType<T>();
+        m_systems[type] = std::make_unique<T>();
+        m_timings[type].name = std::move(name);
+        m_order.push_back(type);
+        buildSchedule();
+        return *(static_cast<T*>(m_systems[type].get()));
+    }
+
+    template <typename T>
+    void setAccess(Signature reads, Signature writes) {
+        assert(isRegistered<T>() && "System not registered.");
+        m_access[getSystemType<T>()] = SystemAccess{ reads, writes, true };
+        buildSchedule();
+    }
+
+    // Runs every system's update. Levels run one after another, the systems inside a level
+    // have no conflicting access and run concurrently on the pool.
+    void update(ECS& ecs, ThreadPool& pool) {
+        for (const auto& level : m_levels) {
+            pool.parallel_for(level.size(), [&](size_t index) {
+                const SystemType type = level[index];
+                const auto start = std::chrono::high_resolution_clock::now();
+                m_systems[type]->update(ecs);
+                const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+                SystemTiming& timing = m_timings[type];
+                timing.last_ms = elapsed.count();
+                timing.total_ms += elapsed.count();
+                ++timing.runs;
+                });
+        }
+    }
+
+    void reportTimings(std::ostream& out) const {
+        for (size_t level = 0; level < m_levels.size(); ++level) {
+            for (const SystemType type : m_levels[level]) {
+                const SystemTiming& timing = m_timings[type];
+                out << "[level " << level << "] " << timing.name << ": last " << timing.last_ms << "ms, mean "
+                    << (timing.runs > 0 ? timing.total_ms / timing.runs : 0.) << "ms over " << timing.runs << " runs\n";
+            }
+        }
     }
 
     template <typename T>
@@ -43,12 +123,35 @@ public:
         m_signatures[getSystemType<T>()] = signature;
     }
     void entityDestroyed(Entity entity) {
-        for (auto& system : m_systems) {
-            system->entities.erase(entity);
+        for (int i = 0; i < nextSystemID; ++i) {
+            if (m_systems[i]) {
+                m_systems[i]->entities.erase(entity);
+            }
+        }
+    }
+    // EntitySignatureChanged for entities first, ..., first + count - 1, which all share
+    // signature
+    void entitiesSignatureChanged(Entity first, Entity count, Signature signature) {
+        for (int i = 0; i < nextSystemID; ++i) {
+            if (!m_systems[i]) {
+                continue;
+            }
+            if ((signature & m_signatures[i]) == m_signatures[i]) {
+                m_systems[i]->entities.insertRange(first, count);
+            }
+            else {
+                for (Entity entity = first; entity < first + count; ++entity) {
+                    m_systems[i]->entities.erase(entity);
+                }
+            }
         }
     }
+
     void EntitySignatureChanged(Entity entity, Signature signature) {
         for (int i = 0; i < nextSystemID; ++i) {
+            if (!m_systems[i]) {
+                continue;
+            }
             if ((signature & m_signatures[i]) == m_signatures[i]) {
                 m_systems[i]->entities.insert(entity);
             }
@@ -59,11 +162,32 @@ public:
     }
 
 private:
+    // Places each system one level after the latest earlier-registered system it conflicts
+    // with, so conflicting systems keep their registration order
+    void buildSchedule() {
+        std::array<size_t, MAX_SYSTEMS> level_of{};
+        m_levels.clear();
+        for (size_t i = 0; i < m_order.size(); ++i) {
+            size_t level = 0;
+            for (size_t j = 0; j < i; ++j) {
+                if (m_access[m_order[i]].conflictsWith(m_access[m_order[j]])) {
+                    level = std::max(level, level_of[j] + 1);
+                }
+            }
+            level_of[i] = level;
+            if (level == m_levels.size()) {
+                m_levels.emplace_back();
+            }
+            m_levels[level].push_back(m_order[i]);
+        }
+    }
+
     std::array<std::unique_ptr<System>, MAX_SYSTEMS> m_systems{}; // Maps system type to its instance
     std::array<Signature, MAX_SYSTEMS> m_signatures{};
-
-
-
+    std::array<SystemAccess, MAX_SYSTEMS> m_access{};
+    std::array<SystemTiming, MAX_SYSTEMS> m_timings{};
+    std::vector<SystemType> m_order; // Registration order
+    std::vector<std::vector<SystemType>> m_levels; // Systems that may run concurrently
 };
 
 
@@ -0,0 +1,59 @@
+#ifndef VIEW_H
+#define VIEW_H
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "entity.h"
+
+template <typename T>
+class ComponentArray;
+
+// Joined iteration over the entities of a registered group. The group keeps its members
+// packed at the front of every owned ComponentArray in the same order, so slot i of each
+// array belongs to the same entity and a view walks all of them in one linear pass.
+// Const-qualified Ts give read-only access.
+template <typename... Ts>
+class View {
+    template <typename T>
+    using ArrayOf = std::conditional_t<std::is_const_v<T>,
+        const ComponentArray<std::remove_const_t<T>>, ComponentArray<T>>;
+
+public:
+    View(size_t size, ArrayOf<Ts>*... arrays) : m_size(size), m_arrays(arrays...) {}
+
+    size_t size() const {
+        return m_size;
+    }
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    // Calls fn(entity, Ts&...) for every entity of the group, one chunk at a time
+    template <typename Fn>
+    void each(Fn&& fn) const {
+        each(fn, std::index_sequence_for<Ts...>{});
+    }
+
+private:
+    template <typename Fn, size_t... Is>
+    void each(Fn& fn, std::index_sequence<Is...>) const {
+        constexpr size_t chunk_size = ComponentArray<std::remove_const_t<
+            std::tuple_element_t<0, std::tuple<Ts...>>>>::CHUNK_SIZE;
+        const std::vector<Entity>& entities = std::get<0>(m_arrays)->entities();
+        for (size_t first = 0; first < m_size; first += chunk_size) {
+            const size_t chunk = first / chunk_size;
+            const size_t count = std::min(chunk_size, m_size - first);
+            const auto components = std::make_tuple(std::get<Is>(m_arrays)->chunk(chunk)...);
+            for (size_t i = 0; i < count; ++i) {
+                fn(entities[first + i], std::get<Is>(components)[i]...);
+            }
+        }
+    }
+
+    size_t m_size;
+    std::tuple<ArrayOf<Ts>*...> m_arrays;
+};
+
+#endif // VIEW_H
@@ -0,0 +1,57 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "ray.h"
+
+namespace render {
+
+    struct AABB {
+        point3 min{ infinity, infinity, infinity };
+        point3 max{ -infinity, -infinity, -infinity };
+
+        void grow(const point3& p) {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        void grow(const AABB& other) {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+
+        bool empty() const {
+            return min.x > max.x || min.y > max.y || min.z > max.z;
+        }
+
+        point3 centroid() const {
+            return (min + max) * real(0.5);
+        }
+
+        real surface_area() const {
+            if (empty()) {
+                return 0.;
+            }
+            const vec3 e = max - min;
+            return 2. * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
+        // Slab test, returns the entry distance or infinity on a miss
+        real hit(const point3& origin, const vec3& inv_direction, real t_min, real t_max) const {
+            for (int axis = 0; axis < 3; ++axis) {
+                real t0 = (min[axis] - origin[axis]) * inv_direction[axis];
+                real t1 = (max[axis] - origin[axis]) * inv_direction[axis];
+                if (inv_direction[axis] < 0.) {
+                    std::swap(t0, t1);
+                }
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+                if (t_max < t_min) {
+                    return infinity;
+                }
+            }
+            return t_min;
+        }
+    };
+
+}
+#endif // AABB_H
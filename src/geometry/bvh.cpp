@@ -0,0 +1,274 @@
+#include "bvh.h"
+#include <algorithm>
+#include <numeric>
+
+namespace render {
+
+	void BVH::build(const std::vector<AABB>& primitive_bounds) {
+		const uint32_t primitive_count = static_cast<uint32_t>(primitive_bounds.size());
+		m_nodes.clear();
+		m_moving_bounds.clear();
+		m_static_first = 0;
+		m_indices.resize(primitive_count);
+		std::iota(m_indices.begin(), m_indices.end(), 0u);
+		if (primitive_count == 0) {
+			return;
+		}
+
+		std::vector<point3> centroids(primitive_count);
+		AABB root_bounds;
+		for (uint32_t i = 0; i < primitive_count; ++i) {
+			centroids[i] = primitive_bounds[i].centroid();
+			root_bounds.grow(primitive_bounds[i]);
+		}
+
+		// A binary tree with n leaves has at most 2n - 1 nodes, reserving avoids reallocations
+		m_nodes.reserve(2 * size_t(primitive_count) - 1);
+		m_nodes.push_back(BVHNode{ root_bounds, 0, primitive_count });
+		subdivide(0, 0, primitive_bounds, centroids);
+		m_nodes.shrink_to_fit();
+	}
+
+	void BVH::build(const std::vector<AABB>& start_bounds, const std::vector<AABB>& end_bounds) {
+		std::vector<AABB> swept(start_bounds);
+		for (size_t i = 0; i < swept.size(); ++i) {
+			swept[i].grow(end_bounds[i]);
+		}
+		build(swept);
+
+		// Lay the leaves out again, moving ones first, so the static ones end up in a
+		// single range at the end
+		const auto is_static = [&](const BVHNode& leaf) {
+			for (uint32_t slot = leaf.left_first; slot < leaf.left_first + leaf.count; ++slot) {
+				const AABB& start = start_bounds[m_indices[slot]];
+				const AABB& end = end_bounds[m_indices[slot]];
+				if (start.min != end.min || start.max != end.max) {
+					return false;
+				}
+			}
+			return true;
+		};
+		std::vector<bool> static_leaf(m_nodes.size());
+		for (size_t i = 0; i < m_nodes.size(); ++i) {
+			static_leaf[i] = m_nodes[i].is_leaf() && is_static(m_nodes[i]);
+		}
+		std::vector<uint32_t> indices;
+		indices.reserve(m_indices.size());
+		for (const bool statics : { false, true }) {
+			if (statics) {
+				m_static_first = uint32_t(indices.size());
+			}
+			for (size_t i = 0; i < m_nodes.size(); ++i) {
+				BVHNode& node = m_nodes[i];
+				if (node.is_leaf() && static_leaf[i] == statics) {
+					const uint32_t first = uint32_t(indices.size());
+					indices.insert(indices.end(), m_indices.begin() + node.left_first, m_indices.begin() + node.left_first + node.count);
+					node.left_first = first;
+				}
+			}
+		}
+		m_indices = std::move(indices);
+
+		// Interpolating costs a few operations per node test, only keep the per-time
+		// bounds when they shrink the moving leaves enough to pay for that. The leaves
+		// are weighed by area times primitive count, the tests a random ray expects there;
+		// the whole tree's cost would hide them behind any large static primitive.
+		fit_moving_bounds(start_bounds, end_bounds);
+		double swept_tests = 0.;
+		double interpolated_tests = 0.;
+		for (size_t i = 0; i < m_nodes.size(); ++i) {
+			const BVHNode& node = m_nodes[i];
+			if (node.is_leaf() && node.left_first < m_static_first) {
+				swept_tests += node.count * node.bounds.surface_area();
+				interpolated_tests += node.count * m_moving_bounds[i].at(real(0.5)).surface_area();
+			}
+		}
+		if (!(interpolated_tests < INTERPOLATION_GAIN * swept_tests)) {
+			m_moving_bounds.clear();
+		}
+	}
+
+	std::vector<AABB> BVH::node_bounds(const std::vector<AABB>& primitive_bounds) const {
+		std::vector<AABB> bounds(m_nodes.size());
+		// Children are always stored after their parent, so a reverse sweep sees both
+		// children of a node before the node itself
+		for (size_t i = m_nodes.size(); i-- > 0;) {
+			const BVHNode& node = m_nodes[i];
+			if (node.is_leaf()) {
+				for (uint32_t slot = node.left_first; slot < node.left_first + node.count; ++slot) {
+					bounds[i].grow(primitive_bounds[m_indices[slot]]);
+				}
+			}
+			else {
+				bounds[i].grow(bounds[node.left_first]);
+				bounds[i].grow(bounds[node.left_first + 1]);
+			}
+		}
+		return bounds;
+	}
+
+	void BVH::refit(const std::vector<AABB>& primitive_bounds) {
+		m_moving_bounds.clear();
+		const std::vector<AABB> bounds = node_bounds(primitive_bounds);
+		for (size_t i = 0; i < m_nodes.size(); ++i) {
+			m_nodes[i].bounds = bounds[i];
+		}
+	}
+
+	void BVH::refit(const std::vector<AABB>& start_bounds, const std::vector<AABB>& end_bounds) {
+		const bool was_interpolated = interpolated();
+		std::vector<AABB> swept(start_bounds);
+		for (size_t i = 0; i < swept.size(); ++i) {
+			swept[i].grow(end_bounds[i]);
+		}
+		refit(swept);
+		if (was_interpolated) {
+			fit_moving_bounds(start_bounds, end_bounds);
+		}
+	}
+
+	void BVH::fit_moving_bounds(const std::vector<AABB>& start_bounds, const std::vector<AABB>& end_bounds) {
+		const std::vector<AABB> start = node_bounds(start_bounds);
+		const std::vector<AABB> end = node_bounds(end_bounds);
+		m_moving_bounds.resize(m_nodes.size());
+		for (size_t i = 0; i < m_nodes.size(); ++i) {
+			m_moving_bounds[i] = MovingBounds(start[i], end[i]);
+		}
+	}
+
+	double BVH::sah_cost() const {
+		if (!interpolated()) {
+			std::vector<AABB> bounds(m_nodes.size());
+			for (size_t i = 0; i < m_nodes.size(); ++i) {
+				bounds[i] = m_nodes[i].bounds;
+			}
+			return sah_cost(bounds);
+		}
+		// Interpolated nodes are judged by their box halfway through the time range
+		std::vector<AABB> bounds(m_nodes.size());
+		for (size_t i = 0; i < m_nodes.size(); ++i) {
+			bounds[i] = m_moving_bounds[i].at(real(0.5));
+		}
+		return sah_cost(bounds);
+	}
+
+	double BVH::sah_cost(const std::vector<AABB>& bounds) const {
+		if (m_nodes.empty() || bounds[0].surface_area() <= 0.) {
+			return 0.;
+		}
+		double cost = 0.;
+		for (size_t i = 0; i < m_nodes.size(); ++i) {
+			const BVHNode& node = m_nodes[i];
+			cost += node.is_leaf() ? bounds[i].surface_area() * node.count : bounds[i].surface_area() * TRAVERSAL_COST;
+		}
+		return cost / bounds[0].surface_area();
+	}
+
+	void BVH::subdivide(uint32_t node_index, int depth,
+		const std::vector<AABB>& primitive_bounds,
+		const std::vector<point3>& centroids) {
+		const uint32_t first = m_nodes[node_index].left_first;
+		const uint32_t count = m_nodes[node_index].count;
+		if (count <= 1 || depth >= MAX_DEPTH) {
+			return;
+		}
+
+		AABB centroid_bounds;
+		for (uint32_t i = first; i < first + count; ++i) {
+			centroid_bounds.grow(centroids[m_indices[i]]);
+		}
+
+		struct Bin {
+			AABB bounds;
+			uint32_t count = 0;
+		};
+
+		// Find the cheapest bin plane, costs are left unnormalized by the parent area
+		int best_axis = -1;
+		int best_plane = 0;
+		double best_cost = infinity;
+		for (int axis = 0; axis < 3; ++axis) {
+			const double extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+			if (extent <= 0.) {
+				continue;
+			}
+			Bin bins[BIN_COUNT];
+			const double scale = BIN_COUNT / extent;
+			for (uint32_t i = first; i < first + count; ++i) {
+				const uint32_t prim = m_indices[i];
+				const int b = std::min(BIN_COUNT - 1, int((centroids[prim][axis] - centroid_bounds.min[axis]) * scale));
+				bins[b].count++;
+				bins[b].bounds.grow(primitive_bounds[prim]);
+			}
+
+			double left_area[BIN_COUNT - 1];
+			uint32_t left_count[BIN_COUNT - 1];
+			AABB left_box;
+			uint32_t left_sum = 0;
+			for (int plane = 0; plane < BIN_COUNT - 1; ++plane) {
+				left_box.grow(bins[plane].bounds);
+				left_sum += bins[plane].count;
+				left_area[plane] = left_box.surface_area();
+				left_count[plane] = left_sum;
+			}
+			AABB right_box;
+			uint32_t right_sum = 0;
+			for (int plane = BIN_COUNT - 2; plane >= 0; --plane) {
+				right_box.grow(bins[plane + 1].bounds);
+				right_sum += bins[plane + 1].count;
+				if (left_count[plane] == 0 || right_sum == 0) {
+					continue;
+				}
+				const double cost = left_count[plane] * left_area[plane] + right_sum * right_box.surface_area();
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_plane = plane;
+				}
+			}
+		}
+
+		const double node_area = m_nodes[node_index].bounds.surface_area();
+		const double leaf_cost = count * node_area;
+		uint32_t left_count = 0;
+		if (best_axis >= 0) {
+			if (TRAVERSAL_COST * node_area + best_cost >= leaf_cost && count <= MAX_LEAF_SIZE) {
+				return;
+			}
+			const double extent = centroid_bounds.max[best_axis] - centroid_bounds.min[best_axis];
+			const double scale = BIN_COUNT / extent;
+			const double axis_min = centroid_bounds.min[best_axis];
+			const auto middle = std::partition(m_indices.begin() + first, m_indices.begin() + first + count,
+				[&](uint32_t prim) {
+					const int b = std::min(BIN_COUNT - 1, int((centroids[prim][best_axis] - axis_min) * scale));
+					return b <= best_plane;
+				});
+			left_count = static_cast<uint32_t>(middle - (m_indices.begin() + first));
+		}
+		else {
+			// All centroids coincide, no plane separates them
+			if (count <= MAX_LEAF_SIZE) {
+				return;
+			}
+			left_count = count / 2;
+		}
+
+		AABB left_bounds, right_bounds;
+		for (uint32_t i = first; i < first + left_count; ++i) {
+			left_bounds.grow(primitive_bounds[m_indices[i]]);
+		}
+		for (uint32_t i = first + left_count; i < first + count; ++i) {
+			right_bounds.grow(primitive_bounds[m_indices[i]]);
+		}
+
+		const uint32_t left_index = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.push_back(BVHNode{ left_bounds, first, left_count });
+		m_nodes.push_back(BVHNode{ right_bounds, first + left_count, count - left_count });
+		m_nodes[node_index].left_first = left_index;
+		m_nodes[node_index].count = 0;
+
+		subdivide(left_index, depth + 1, primitive_bounds, centroids);
+		subdivide(left_index + 1, depth + 1, primitive_bounds, centroids);
+	}
+
+}
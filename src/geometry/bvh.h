@@ -0,0 +1,201 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstdint>
+#include <vector>
+#include "aabb.h"
+#include "ray_packet.h"
+
+namespace render {
+
+    // Node of the flattened hierarchy. The two children of an interior node are stored
+    // next to each other, so only the index of the left one is kept.
+    struct BVHNode {
+        AABB bounds;
+        uint32_t left_first; // Left child for interior nodes, first primitive slot for leaves
+        uint32_t count; // Number of primitives in a leaf, 0 for interior nodes
+
+        bool is_leaf() const {
+            return count > 0;
+        }
+    };
+
+    // Node bounds moving linearly over the ray time range, kept as the start box and
+    // the velocity of its corners so a ray evaluates them with one multiply-add per plane
+    struct MovingBounds {
+        AABB start;
+        vec3 min_velocity;
+        vec3 max_velocity;
+
+        MovingBounds() = default;
+        MovingBounds(const AABB& start_bounds, const AABB& end_bounds)
+            : start(start_bounds), min_velocity(end_bounds.min - start_bounds.min), max_velocity(end_bounds.max - start_bounds.max) {}
+
+        AABB at(real time) const {
+            return AABB{ start.min + min_velocity * time, start.max + max_velocity * time };
+        }
+    };
+
+    class BVH {
+    public:
+        // Binned SAH build over the bounds of each primitive
+        void build(const std::vector<AABB>& primitive_bounds);
+        // Build for primitives moving linearly over the ray time range [0, 1), from the
+        // swept bounds. When the primitives move far enough for swept boxes to overlap
+        // badly, the nodes also keep their bounds at both ends and a ray tests them
+        // interpolated to its time. Leaves whose primitives all stay put get the slots
+        // from static_first() on.
+        void build(const std::vector<AABB>& start_bounds, const std::vector<AABB>& end_bounds);
+
+        // Recomputes every node's bounds bottom-up from new primitive bounds, indexed as at
+        // build time, keeping the topology. Much cheaper than build(), but the tree gets
+        // worse as primitives drift from where they were when it was built.
+        void refit(const std::vector<AABB>& primitive_bounds);
+        // Keeps the leaf layout and the choice of interpolating made by build()
+        void refit(const std::vector<AABB>& start_bounds, const std::vector<AABB>& end_bounds);
+
+        // Whether traversal interpolates node bounds by ray time
+        bool interpolated() const {
+            return !m_moving_bounds.empty();
+        }
+
+        // Slots from here on only hold primitives with equal start and end bounds, every
+        // slot does for static builds
+        uint32_t static_first() const {
+            return m_static_first;
+        }
+
+        // Expected traversal cost of a random ray hitting the root, by the same surface
+        // area heuristic the build minimizes. Lets callers see how far refits degraded it.
+        double sah_cost() const;
+
+        // Visits the leaves the ray reaches, nearest first. intersect(first, count) tests
+        // primitive slots [first, first + count) and lowers t_max when it finds a closer hit.
+        template <typename LeafFn>
+        void traverse(const Ray& r, real t_min, real& t_max, LeafFn&& intersect) const {
+            if (interpolated()) {
+                traverse_nodes<true>(r, t_min, t_max, intersect);
+            }
+            else {
+                traverse_nodes<false>(r, t_min, t_max, intersect);
+            }
+        }
+
+        // Visits every leaf that some ray of a coherent packet may reach, nearest first by
+        // the bundle's entry bound. Nodes are tested by their swept bounds, which hold at
+        // every ray time. intersect(first, count) tests the packet's rays and lowers t_max
+        // to the farthest closest hit among them.
+        template <typename LeafFn>
+        void traverse_packet(const RayInterval& rays, real t_min, real& t_max, LeafFn&& intersect) const {
+            if (m_nodes.empty()) {
+                return;
+            }
+            const auto node_hit = [&](uint32_t index) {
+                return rays.hit(m_nodes[index].bounds, t_min, t_max);
+            };
+            walk(node_hit, t_max, intersect);
+        }
+
+        const std::vector<BVHNode>& nodes() const {
+            return m_nodes;
+        }
+
+        // Maps each primitive slot referenced by the leaves to the index given at build time
+        const std::vector<uint32_t>& primitive_indices() const {
+            return m_indices;
+        }
+
+        size_t node_count() const {
+            return m_nodes.size();
+        }
+
+    private:
+        template <bool Interpolate, typename LeafFn>
+        void traverse_nodes(const Ray& r, real t_min, real& t_max, LeafFn& intersect) const {
+            if (m_nodes.empty()) {
+                return;
+            }
+            const vec3 inv_direction = real(1) / r.direction;
+            const auto node_hit = [&](uint32_t index) {
+                if constexpr (Interpolate) {
+                    return m_moving_bounds[index].at(r.time).hit(r.origin, inv_direction, t_min, t_max);
+                }
+                else {
+                    return m_nodes[index].bounds.hit(r.origin, inv_direction, t_min, t_max);
+                }
+            };
+            walk(node_hit, t_max, intersect);
+        }
+
+        // Depth-first, near child first, skipping subtrees node_hit misses or enters
+        // past t_max
+        template <typename HitFn, typename LeafFn>
+        void walk(const HitFn& node_hit, const real& t_max, LeafFn& intersect) const {
+            if (node_hit(0) == infinity) {
+                return;
+            }
+
+            uint32_t stack[MAX_DEPTH + 1];
+            real stack_t[MAX_DEPTH + 1];
+            int stack_size = 0;
+            uint32_t node_index = 0;
+            while (true) {
+                const BVHNode& node = m_nodes[node_index];
+                if (node.is_leaf()) {
+                    intersect(node.left_first, node.count);
+                }
+                else {
+                    uint32_t near_child = node.left_first;
+                    uint32_t far_child = node.left_first + 1;
+                    real t_near = node_hit(near_child);
+                    real t_far = node_hit(far_child);
+                    if (t_far < t_near) {
+                        std::swap(near_child, far_child);
+                        std::swap(t_near, t_far);
+                    }
+                    if (t_near != infinity) {
+                        if (t_far != infinity) {
+                            stack[stack_size] = far_child;
+                            stack_t[stack_size] = t_far;
+                            ++stack_size;
+                        }
+                        node_index = near_child;
+                        continue;
+                    }
+                }
+                // Pop the next node that can still hold a closer hit
+                do {
+                    if (stack_size == 0) {
+                        return;
+                    }
+                    --stack_size;
+                } while (stack_t[stack_size] > t_max);
+                node_index = stack[stack_size];
+            }
+        }
+
+        static constexpr int BIN_COUNT = 16;
+        static constexpr int MAX_DEPTH = 64;
+        static constexpr uint32_t MAX_LEAF_SIZE = 8;
+        static constexpr double TRAVERSAL_COST = 1.;
+        // Interpolated bounds must bring the expected tests in moving leaves below this
+        // fraction of the swept ones
+        static constexpr double INTERPOLATION_GAIN = 0.6;
+
+        // Bounds of every node, bottom-up from the given primitive bounds
+        std::vector<AABB> node_bounds(const std::vector<AABB>& primitive_bounds) const;
+        void fit_moving_bounds(const std::vector<AABB>& start_bounds, const std::vector<AABB>& end_bounds);
+        double sah_cost(const std::vector<AABB>& bounds) const;
+
+        void subdivide(uint32_t node_index, int depth,
+            const std::vector<AABB>& primitive_bounds,
+            const std::vector<point3>& centroids);
+
+        std::vector<BVHNode> m_nodes; // Swept bounds for moving builds
+        std::vector<MovingBounds> m_moving_bounds; // Empty unless interpolated
+        std::vector<uint32_t> m_indices;
+        uint32_t m_static_first = 0;
+    };
+
+}
+#endif // BVH_H
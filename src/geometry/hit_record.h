@@ -8,7 +8,7 @@ namespace render {
 
 
     struct HitRecord {
-        HitRecord(double t, point3 p, vec3 n, Ray r) : t(t), p(p) {
+        HitRecord(real t, point3 p, vec3 n, Ray r) : t(t), p(p) {
             if (glm::dot(r.direction, n) >= 0) {
                 normal = -n;
                 front_face = false;
@@ -18,11 +18,11 @@ namespace render {
                 front_face = true;
             }
         }
-        double t;
+        real t;
         point3 p;
         vec3 normal;
         bool front_face;
-        Entity entity;
+        uint32_t material; // Index into the scene's material table
     };
 
 }
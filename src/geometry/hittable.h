@@ -2,13 +2,36 @@
 #define HITTABLE_H
 
 #include "ray.h"
+#include "aabb.h"
 
 
 namespace render {
     struct Sphere {
         point3 center;
-        double radius;
+        real radius;
         vec3 direction{ 0.,0.,0. };
+
+        bool moving() const {
+            return direction != vec3(0., 0., 0.);
+        }
+
+        // Bounds at one ray time
+        AABB bounds_at(real time) const {
+            const point3 c = center + direction * time;
+            const vec3 r(radius, radius, radius);
+            return AABB{ c - r, c + r };
+        }
+
+        // Bounds of the volume swept over the ray time range [0, 1)
+        AABB bounds() const {
+            const vec3 r(radius, radius, radius);
+            AABB box;
+            box.grow(center - r);
+            box.grow(center + r);
+            box.grow(center + direction - r);
+            box.grow(center + direction + r);
+            return box;
+        }
     };
 }
-#endif
\ No newline at end of file
+#endif
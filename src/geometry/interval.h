@@ -10,21 +10,21 @@ namespace render {
 
 
     struct Interval {
-        const double min, max;
+        const real min, max;
 
         constexpr Interval() : min(-infinity), max(infinity) {};
-        constexpr Interval(double min, double max) : min(min), max(max) {};
-        constexpr double size() const {
+        constexpr Interval(real min, real max) : min(min), max(max) {};
+        constexpr real size() const {
             return max - min;
         }
-        constexpr bool contains(double x) const {
+        constexpr bool contains(real x) const {
             return x <= max && x >= min;
         }
-        constexpr bool surrounds(double x) const {
+        constexpr bool surrounds(real x) const {
             return x<max && x >min;
         }
-        constexpr double clamp(double x) const {
-            return std::clamp<double>(x,min,max);
+        constexpr real clamp(real x) const {
+            return std::clamp<real>(x,min,max);
         }
         static const Interval empty, universe;
 
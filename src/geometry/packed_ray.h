@@ -0,0 +1,43 @@
+#ifndef PACKED_RAY_H
+#define PACKED_RAY_H
+
+#include <cstdint>
+#include "ray.h"
+
+namespace render {
+
+    // Single precision copy of a Ray for the wavefront queues. Intersection and shading
+    // still run at the build's precision, only the storage between stages is narrowed.
+    struct PackedRay {
+        glm::vec3 origin;
+        glm::vec3 direction;
+        glm::vec3 attenuation;
+        float time;
+        uint32_t index;
+        int32_t depth;
+
+        static PackedRay pack(const Ray& r) {
+            return PackedRay{
+                glm::vec3(r.origin), glm::vec3(r.direction), glm::vec3(r.attenuation),
+                float(r.time), uint32_t(r.index), r.depth
+            };
+        }
+
+        Ray unpack() const {
+            return Ray(point3(origin), vec3(direction), real(time), color(attenuation), int(index), depth);
+        }
+    };
+    static_assert(sizeof(PackedRay) == 48, "PackedRay should stay at 48 bytes");
+
+    // Closest hit found for the ray at queue position ray
+    struct PackedHit {
+        real t;
+        // Slot as SceneSnapshot numbers them: a sphere below spheres.size(), a triangle from
+        // there on, resolved by SceneSnapshot::is_triangle and material_index
+        uint32_t slot;
+        uint32_t ray;
+    };
+    static_assert(sizeof(PackedHit) <= 16, "PackedHit should stay within 16 bytes");
+
+}
+#endif // PACKED_RAY_H
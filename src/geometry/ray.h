@@ -14,7 +14,7 @@ namespace render {
         constexpr Ray(
             point3 origin,
             vec3 direction,
-            double time,
+            real time,
             color attenuation,
             int index,
             int depth
@@ -43,12 +43,12 @@ namespace render {
             return Ray(new_origin, new_direction, time, new_attenuation, index, depth - 1);
         }
 
-        constexpr point3 at(double t) const {
+        constexpr point3 at(real t) const {
             return origin + t * direction;
         }
         point3 origin;
         vec3 direction;
-        double time;
+        real time;
         color attenuation;
         int index;
         int depth;
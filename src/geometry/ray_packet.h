@@ -0,0 +1,140 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include "aabb.h"
+
+namespace render {
+
+    // Conservative bounds of a bundle of rays whose direction components each keep one
+    // sign: the box holding their origins and the range of each inverse direction
+    // component. A box no ray of the bundle can reach fails hit() for the whole bundle.
+    struct RayInterval {
+        point3 origin_min{ infinity, infinity, infinity };
+        point3 origin_max{ -infinity, -infinity, -infinity };
+        vec3 inv_min{ infinity, infinity, infinity };
+        vec3 inv_max{ -infinity, -infinity, -infinity };
+
+        // Lower bound on where any ray of the bundle enters the box within [t_min, t_max],
+        // infinity when none can. Interval products with the same rounding as the single
+        // ray slab test, so the bound never cuts off a box one of the rays hits.
+        real hit(const AABB& box, real t_min, real t_max) const {
+            for (int axis = 0; axis < 3; ++axis) {
+                const real i0 = inv_min[axis], i1 = inv_max[axis];
+                const real n0 = (box.min[axis] - origin_max[axis]) * i0;
+                const real n1 = (box.min[axis] - origin_max[axis]) * i1;
+                const real n2 = (box.min[axis] - origin_min[axis]) * i0;
+                const real n3 = (box.min[axis] - origin_min[axis]) * i1;
+                const real f0 = (box.max[axis] - origin_max[axis]) * i0;
+                const real f1 = (box.max[axis] - origin_max[axis]) * i1;
+                const real f2 = (box.max[axis] - origin_min[axis]) * i0;
+                const real f3 = (box.max[axis] - origin_min[axis]) * i1;
+                // Positive directions enter through the min plane, negative ones through max
+                const bool positive = i0 > 0;
+                const real enter = positive ? std::min(std::min(n0, n1), std::min(n2, n3)) : std::min(std::min(f0, f1), std::min(f2, f3));
+                const real exit = positive ? std::max(std::max(f0, f1), std::max(f2, f3)) : std::max(std::max(n0, n1), std::max(n2, n3));
+                t_min = enter > t_min ? enter : t_min;
+                t_max = exit < t_max ? exit : t_max;
+                if (t_max < t_min) {
+                    return infinity;
+                }
+            }
+            return t_min;
+        }
+    };
+
+    // Camera rays of a block of neighbouring pixels, laid out one field per array so the
+    // packet kernels test simd::vreal::width rays per instruction against one primitive.
+    // t and slot hold each ray's closest hit so far.
+    struct RayPacket {
+        static constexpr int MAX_SIDE = 8; // Largest square block of pixels
+        static constexpr int MAX_RAYS = MAX_SIDE * MAX_SIDE;
+
+        alignas(64) real origin_x[MAX_RAYS], origin_y[MAX_RAYS], origin_z[MAX_RAYS];
+        alignas(64) real direction_x[MAX_RAYS], direction_y[MAX_RAYS], direction_z[MAX_RAYS];
+        alignas(64) real length2[MAX_RAYS]; // Squared direction length
+        alignas(64) real time[MAX_RAYS];
+        alignas(64) real t[MAX_RAYS];
+        int64_t slot[MAX_RAYS];
+        color attenuation[MAX_RAYS];
+        int index[MAX_RAYS];
+        int depth[MAX_RAYS];
+        int size = 0;
+
+        void clear() {
+            size = 0;
+        }
+
+        void push_back(const Ray& r, real t_max) {
+            assert(size < MAX_RAYS && "Ray packet full.");
+            set_lane(size++, r, t_max);
+        }
+
+        // Lanes up to the next multiple of simd::vreal::width, which the kernels also run.
+        // pad() fills them with copies of the last ray so they widen no bounds.
+        int padded_size(int width) const {
+            return (size + width - 1) / width * width;
+        }
+        void pad(int width) {
+            for (int k = size; k < padded_size(width); ++k) {
+                set_lane(k, ray(size - 1), t[size - 1]);
+            }
+        }
+
+        // Whether every direction component keeps its sign, and stays off zero, across
+        // the packet. Packets that straddle an axis get no useful interval bounds.
+        bool coherent() const {
+            const auto same_sign = [&](const real* d) {
+                const bool positive = d[0] > 0;
+                for (int k = 0; k < size; ++k) {
+                    if (positive ? !(d[k] > 0) : !(d[k] < 0)) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+            return same_sign(direction_x) && same_sign(direction_y) && same_sign(direction_z);
+        }
+
+        // Only meaningful for coherent packets
+        RayInterval bounds() const {
+            RayInterval bounds;
+            for (int k = 0; k < size; ++k) {
+                const point3 o(origin_x[k], origin_y[k], origin_z[k]);
+                const vec3 inv = real(1) / vec3(direction_x[k], direction_y[k], direction_z[k]);
+                bounds.origin_min = glm::min(bounds.origin_min, o);
+                bounds.origin_max = glm::max(bounds.origin_max, o);
+                bounds.inv_min = glm::min(bounds.inv_min, inv);
+                bounds.inv_max = glm::max(bounds.inv_max, inv);
+            }
+            return bounds;
+        }
+
+        Ray ray(int k) const {
+            return Ray(point3(origin_x[k], origin_y[k], origin_z[k]), vec3(direction_x[k], direction_y[k], direction_z[k]),
+                time[k], attenuation[k], index[k], depth[k]);
+        }
+
+        // Farthest closest-hit distance of any ray, the packet's traversal limit
+        real max_t() const {
+            return *std::max_element(t, t + size);
+        }
+
+    private:
+        void set_lane(int k, const Ray& r, real t_max) {
+            origin_x[k] = r.origin.x; origin_y[k] = r.origin.y; origin_z[k] = r.origin.z;
+            direction_x[k] = r.direction.x; direction_y[k] = r.direction.y; direction_z[k] = r.direction.z;
+            length2[k] = glm::length2(r.direction);
+            time[k] = r.time;
+            t[k] = t_max;
+            slot[k] = -1;
+            attenuation[k] = r.attenuation;
+            index[k] = r.index;
+            depth[k] = r.depth;
+        }
+    };
+
+}
+#endif // RAY_PACKET_H
@@ -0,0 +1,218 @@
+#ifndef SPHERE_SOA_H
+#define SPHERE_SOA_H
+
+#include <cstdint>
+#include "../aligned_allocator.h"
+#include "../simd.h"
+#include "hittable.h"
+#include "ray_packet.h"
+
+namespace render {
+
+    // Spheres packed one field per array so the intersection kernel can load
+    // simd::vreal::width consecutive spheres with a single instruction per field.
+    struct SphereSoA {
+        aligned_vector<real> center_x, center_y, center_z;
+        aligned_vector<real> direction_x, direction_y, direction_z;
+        aligned_vector<real> radius2;
+        aligned_vector<uint32_t> material; // Index into the scene's material table
+
+        void clear() {
+            center_x.clear(); center_y.clear(); center_z.clear();
+            direction_x.clear(); direction_y.clear(); direction_z.clear();
+            radius2.clear();
+            material.clear();
+            m_size = 0;
+        }
+
+        void reserve(size_t n) {
+            const size_t capacity = n + simd::vreal::width - 1;
+            center_x.reserve(capacity); center_y.reserve(capacity); center_z.reserve(capacity);
+            direction_x.reserve(capacity); direction_y.reserve(capacity); direction_z.reserve(capacity);
+            radius2.reserve(capacity);
+            material.reserve(capacity);
+        }
+
+        void push_back(const Sphere& sphere, uint32_t material_index) {
+            assert(center_x.size() == m_size && "Cannot add spheres after pad()");
+            center_x.push_back(sphere.center.x);
+            center_y.push_back(sphere.center.y);
+            center_z.push_back(sphere.center.z);
+            direction_x.push_back(sphere.direction.x);
+            direction_y.push_back(sphere.direction.y);
+            direction_z.push_back(sphere.direction.z);
+            radius2.push_back(sphere.radius * sphere.radius);
+            material.push_back(material_index);
+            ++m_size;
+        }
+
+        // Moves slot i to the sphere's new geometry, its material stays
+        void set(size_t i, const Sphere& sphere) {
+            center_x[i] = sphere.center.x;
+            center_y[i] = sphere.center.y;
+            center_z[i] = sphere.center.z;
+            direction_x[i] = sphere.direction.x;
+            direction_y[i] = sphere.direction.y;
+            direction_z[i] = sphere.direction.z;
+            radius2[i] = sphere.radius * sphere.radius;
+        }
+
+        // Appends the tail the kernel may read past the last sphere. A negative radius²
+        // can never produce a real root, so the padding never reports a hit.
+        void pad() {
+            for (int i = 0; i < simd::vreal::width - 1; ++i) {
+                center_x.push_back(0.); center_y.push_back(0.); center_z.push_back(0.);
+                direction_x.push_back(0.); direction_y.push_back(0.); direction_z.push_back(0.);
+                radius2.push_back(-1.);
+                material.push_back(0);
+            }
+        }
+
+        size_t size() const {
+            return m_size;
+        }
+
+        point3 center(size_t i, real time) const {
+            return point3(center_x[i], center_y[i], center_z[i]) + vec3(direction_x[i], direction_y[i], direction_z[i]) * time;
+        }
+
+        real radius(size_t i) const {
+            return std::sqrt(radius2[i]);
+        }
+
+    private:
+        size_t m_size = 0;
+    };
+
+    // Tests slots [first, first + count) against the ray, simd::vreal::width spheres at a time.
+    // Returns the slot of the closest hit in (t_min, t_max) and lowers t_max to it, or -1 on a miss.
+    // The last group may also test spheres just past the range, any hit they report is still a
+    // real and closer intersection, so the result stays correct. Moving = false drops the
+    // motion terms, for slots known to hold static spheres only, so the spheres past a static
+    // range must be static or padding too.
+    template <bool Moving = true>
+    inline int64_t intersect_spheres(const SphereSoA& spheres, uint32_t first, uint32_t count,
+        const Ray& r, real t_min, real& t_max) {
+        using simd::vreal;
+
+        const vreal ox = vreal::broadcast(r.origin.x);
+        const vreal oy = vreal::broadcast(r.origin.y);
+        const vreal oz = vreal::broadcast(r.origin.z);
+        const vreal dx = vreal::broadcast(r.direction.x);
+        const vreal dy = vreal::broadcast(r.direction.y);
+        const vreal dz = vreal::broadcast(r.direction.z);
+        const vreal time = vreal::broadcast(r.time);
+        const vreal a = vreal::broadcast(glm::length2(r.direction));
+        const vreal lower = vreal::broadcast(t_min);
+        const vreal zero = vreal::broadcast(0);
+
+        vreal best_t = vreal::broadcast(t_max);
+        vreal best_slot = simd::no_slot(vreal{});
+        const uint32_t end = first + count;
+        for (uint32_t i = first; i < end; i += vreal::width) {
+            vreal cx = vreal::load(&spheres.center_x[i]);
+            vreal cy = vreal::load(&spheres.center_y[i]);
+            vreal cz = vreal::load(&spheres.center_z[i]);
+            if constexpr (Moving) {
+                cx = cx + vreal::load(&spheres.direction_x[i]) * time;
+                cy = cy + vreal::load(&spheres.direction_y[i]) * time;
+                cz = cz + vreal::load(&spheres.direction_z[i]) * time;
+            }
+            const vreal ocx = cx - ox;
+            const vreal ocy = cy - oy;
+            const vreal ocz = cz - oz;
+            const vreal h = dx * ocx + dy * ocy + dz * ocz;
+            const vreal c = ocx * ocx + ocy * ocy + ocz * ocz - vreal::load(&spheres.radius2[i]);
+            const vreal discriminant = h * h - a * c;
+            const auto real_roots = discriminant >= zero;
+            if (!simd::any(real_roots)) {
+                continue;
+            }
+
+            const vreal sqrtd = simd::sqrt(simd::max(discriminant, zero));
+            const vreal near_root = (h - sqrtd) / a;
+            const vreal far_root = (h + sqrtd) / a;
+            const auto near_ok = (near_root > lower) & (near_root < best_t);
+            const auto far_ok = (far_root > lower) & (far_root < best_t);
+            const auto closer = real_roots & (near_ok | far_ok);
+            best_t = simd::select(closer, simd::select(near_ok, near_root, far_root), best_t);
+            best_slot = simd::select(closer, simd::slots(vreal{}, i), best_slot);
+        }
+
+        real lane_t[vreal::width];
+        real lane_slot[vreal::width];
+        best_t.store(lane_t);
+        best_slot.store(lane_slot);
+        int64_t closest = -1;
+        for (int lane = 0; lane < vreal::width; ++lane) {
+            const int64_t slot = simd::decode_slot(lane_slot[lane]);
+            if (slot >= 0 && lane_t[lane] < t_max) {
+                t_max = lane_t[lane];
+                closest = slot;
+            }
+        }
+        return closest;
+    }
+
+    // Tests slots [first, first + count) against every ray of the packet, simd::vreal::width
+    // rays at a time, lowering each ray's t and setting its slot on a closer hit in
+    // (t_min, t). The packet must be padded. Each lane runs the same arithmetic as
+    // intersect_spheres, so a ray finds the same hit either way.
+    inline void intersect_spheres_packet(const SphereSoA& spheres, uint32_t first, uint32_t count,
+        RayPacket& packet, real t_min) {
+        using simd::vreal;
+
+        const vreal lower = vreal::broadcast(t_min);
+        const vreal zero = vreal::broadcast(0);
+        const int lanes = packet.padded_size(vreal::width);
+        const uint32_t end = first + count;
+        for (uint32_t i = first; i < end; ++i) {
+            const vreal center_x = vreal::broadcast(spheres.center_x[i]);
+            const vreal center_y = vreal::broadcast(spheres.center_y[i]);
+            const vreal center_z = vreal::broadcast(spheres.center_z[i]);
+            const vreal direction_x = vreal::broadcast(spheres.direction_x[i]);
+            const vreal direction_y = vreal::broadcast(spheres.direction_y[i]);
+            const vreal direction_z = vreal::broadcast(spheres.direction_z[i]);
+            const vreal radius2 = vreal::broadcast(spheres.radius2[i]);
+            for (int k = 0; k < lanes; k += vreal::width) {
+                // A static sphere's zero motion adds exactly nothing
+                const vreal time = vreal::load(&packet.time[k]);
+                const vreal cx = center_x + direction_x * time;
+                const vreal cy = center_y + direction_y * time;
+                const vreal cz = center_z + direction_z * time;
+                const vreal ocx = cx - vreal::load(&packet.origin_x[k]);
+                const vreal ocy = cy - vreal::load(&packet.origin_y[k]);
+                const vreal ocz = cz - vreal::load(&packet.origin_z[k]);
+                const vreal h = vreal::load(&packet.direction_x[k]) * ocx + vreal::load(&packet.direction_y[k]) * ocy
+                    + vreal::load(&packet.direction_z[k]) * ocz;
+                const vreal c = ocx * ocx + ocy * ocy + ocz * ocz - radius2;
+                const vreal a = vreal::load(&packet.length2[k]);
+                const vreal discriminant = h * h - a * c;
+                const auto real_roots = discriminant >= zero;
+                if (!simd::any(real_roots)) {
+                    continue;
+                }
+
+                const vreal best_t = vreal::load(&packet.t[k]);
+                const vreal sqrtd = simd::sqrt(simd::max(discriminant, zero));
+                const vreal near_root = (h - sqrtd) / a;
+                const vreal far_root = (h + sqrtd) / a;
+                const auto near_ok = (near_root > lower) & (near_root < best_t);
+                const auto far_ok = (far_root > lower) & (far_root < best_t);
+                const auto closer = real_roots & (near_ok | far_ok);
+                const int hits = simd::bits(closer);
+                if (hits == 0) {
+                    continue;
+                }
+                simd::select(closer, simd::select(near_ok, near_root, far_root), best_t).store(&packet.t[k]);
+                for (int lane = 0; lane < vreal::width; ++lane) {
+                    if (hits & (1 << lane)) {
+                        packet.slot[k + lane] = i;
+                    }
+                }
+            }
+        }
+    }
+
+}
+#endif // SPHERE_SOA_H
@@ -0,0 +1,152 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "ray.h"
+#include "aabb.h"
+
+namespace render {
+
+    // Vertex and index buffers of a triangle mesh. Triangles share their corners through
+    // the index buffer instead of storing three positions each.
+    struct MeshBuffers {
+        std::vector<point3> positions;
+        std::vector<uint32_t> indices; // Three per triangle, into positions
+
+        size_t triangle_count() const {
+            return indices.size() / 3;
+        }
+    };
+
+    // Component for a static triangle mesh, drawn with the entity's Material. Entities
+    // showing the same mesh share its buffers, so the component is a single pointer.
+    struct TriangleMesh {
+        std::shared_ptr<const MeshBuffers> buffers;
+
+        size_t triangle_count() const {
+            return buffers ? buffers->triangle_count() : 0;
+        }
+    };
+
+    // Triangle of a scene's mesh store, corners index its vertices
+    struct IndexedTriangle {
+        uint32_t v0, v1, v2;
+        uint32_t material; // Index into the scene's material table
+    };
+
+    // Every mesh of a scene: one vertex buffer, and the triangles in BVH leaf order so a
+    // leaf tests a contiguous range
+    struct TriangleStore {
+        std::vector<point3> vertices;
+        std::vector<IndexedTriangle> triangles;
+
+        size_t size() const {
+            return triangles.size();
+        }
+
+        AABB bounds(size_t i) const {
+            AABB box;
+            box.grow(vertices[triangles[i].v0]);
+            box.grow(vertices[triangles[i].v1]);
+            box.grow(vertices[triangles[i].v2]);
+            return box;
+        }
+
+        // Geometric normal, not normalized, wound by the triangle's corner order
+        vec3 normal(size_t i) const {
+            const point3& p0 = vertices[triangles[i].v0];
+            return glm::cross(vertices[triangles[i].v1] - p0, vertices[triangles[i].v2] - p0);
+        }
+    };
+
+    // Per-ray setup of the watertight test (Woop, Benthin and Wald, JCGT 2013). The ray is
+    // turned into a shear that maps its direction onto +z, so every triangle is tested in
+    // 2D from the same edge functions whichever triangle shares the edge: no ray slips
+    // through the seam between two triangles, as it can with Möller-Trumbore.
+    struct WatertightRay {
+        WatertightRay() = default;
+        explicit WatertightRay(const Ray& r) : origin(r.origin) {
+            const vec3 d = r.direction;
+            const real ax = std::abs(d.x), ay = std::abs(d.y), az = std::abs(d.z);
+            kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            // Keep the winding of the 2D edge functions independent of the direction's sign
+            if (d[kz] < 0) {
+                std::swap(kx, ky);
+            }
+            shear_x = d[kx] / d[kz];
+            shear_y = d[ky] / d[kz];
+            shear_z = real(1) / d[kz];
+        }
+
+        point3 origin;
+        int kx, ky, kz;
+        real shear_x, shear_y, shear_z;
+    };
+
+    // Distance to the triangle p0 p1 p2 when the ray hits it in (t_min, t_max), from
+    // either side. Edge hits count for both triangles sharing the edge.
+    inline bool intersect_triangle(const WatertightRay& ray, const point3& p0, const point3& p1, const point3& p2,
+        real t_min, real t_max, real& t) {
+        const vec3 a = p0 - ray.origin;
+        const vec3 b = p1 - ray.origin;
+        const vec3 c = p2 - ray.origin;
+        const real ax = a[ray.kx] - ray.shear_x * a[ray.kz];
+        const real ay = a[ray.ky] - ray.shear_y * a[ray.kz];
+        const real bx = b[ray.kx] - ray.shear_x * b[ray.kz];
+        const real by = b[ray.ky] - ray.shear_y * b[ray.kz];
+        const real cx = c[ray.kx] - ray.shear_x * c[ray.kz];
+        const real cy = c[ray.ky] - ray.shear_y * c[ray.kz];
+
+        real u = cx * by - cy * bx;
+        real v = ax * cy - ay * cx;
+        real w = bx * ay - by * ax;
+        // A zero edge function in float may be rounding, redo the edge in double so a ray
+        // on a shared edge agrees for both triangles
+        if constexpr (std::is_same_v<real, float>) {
+            if (u == 0 || v == 0 || w == 0) {
+                u = real(double(cx) * double(by) - double(cy) * double(bx));
+                v = real(double(ax) * double(cy) - double(ay) * double(cx));
+                w = real(double(bx) * double(ay) - double(by) * double(ax));
+            }
+        }
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) {
+            return false;
+        }
+        const real det = u + v + w;
+        if (det == 0) {
+            return false;
+        }
+        const real scaled_t = ray.shear_z * (u * a[ray.kz] + v * b[ray.kz] + w * c[ray.kz]);
+        const real hit_t = scaled_t / det;
+        if (!(hit_t > t_min && hit_t < t_max)) {
+            return false;
+        }
+        t = hit_t;
+        return true;
+    }
+
+    // Tests slots [first, first + count) against the ray. Returns the slot of the closest
+    // hit in (t_min, t_max) and lowers t_max to it, or -1 on a miss.
+    inline int64_t intersect_triangles(const TriangleStore& store, uint32_t first, uint32_t count,
+        const WatertightRay& ray, real t_min, real& t_max) {
+        int64_t closest = -1;
+        const uint32_t end = first + count;
+        for (uint32_t i = first; i < end; ++i) {
+            const IndexedTriangle& tri = store.triangles[i];
+            real t;
+            if (intersect_triangle(ray, store.vertices[tri.v0], store.vertices[tri.v1], store.vertices[tri.v2], t_min, t_max, t)) {
+                t_max = t;
+                closest = i;
+            }
+        }
+        return closest;
+    }
+
+}
+#endif // TRIANGLE_MESH_H
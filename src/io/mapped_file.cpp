@@ -0,0 +1,136 @@
+#include "mapped_file.h"
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path, size_t size) : m_size(size) {
+	m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		m_file = nullptr;
+		throw std::runtime_error("Cannot create " + path);
+	}
+	const DWORD size_high = DWORD(uint64_t(size) >> 32);
+	const DWORD size_low = DWORD(uint64_t(size) & 0xffffffffu);
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, size_high, size_low, nullptr);
+	if (m_mapping == nullptr) {
+		CloseHandle(m_file);
+		throw std::runtime_error("Cannot map " + path);
+	}
+	m_data = static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size));
+	if (m_data == nullptr) {
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+		throw std::runtime_error("Cannot map " + path);
+	}
+}
+
+MappedFile::MappedFile(const std::string& path) {
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		m_file = nullptr;
+		throw std::runtime_error("Cannot open " + path);
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size)) {
+		CloseHandle(m_file);
+		throw std::runtime_error("Cannot read the size of " + path);
+	}
+	m_size = size_t(size.QuadPart);
+	// Empty files cannot be mapped, they are left with a null data()
+	if (m_size == 0) {
+		return;
+	}
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr) {
+		CloseHandle(m_file);
+		throw std::runtime_error("Cannot map " + path);
+	}
+	m_data = static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr) {
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+		throw std::runtime_error("Cannot map " + path);
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (m_data != nullptr) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping != nullptr) {
+		CloseHandle(m_mapping);
+	}
+	CloseHandle(m_file);
+}
+
+void MappedFile::flush() {
+	FlushViewOfFile(m_data, m_size);
+	FlushFileBuffers(m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path, size_t size) : m_size(size) {
+	m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0) {
+		throw std::runtime_error("Cannot create " + path);
+	}
+	if (ftruncate(m_fd, off_t(size)) != 0) {
+		close(m_fd);
+		throw std::runtime_error("Cannot resize " + path);
+	}
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) {
+		close(m_fd);
+		throw std::runtime_error("Cannot map " + path);
+	}
+	m_data = static_cast<char*>(data);
+}
+
+MappedFile::MappedFile(const std::string& path) {
+	m_fd = open(path.c_str(), O_RDONLY);
+	if (m_fd < 0) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	struct stat info;
+	if (fstat(m_fd, &info) != 0) {
+		close(m_fd);
+		throw std::runtime_error("Cannot read the size of " + path);
+	}
+	m_size = size_t(info.st_size);
+	// Empty files cannot be mapped, they are left with a null data()
+	if (m_size == 0) {
+		return;
+	}
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) {
+		close(m_fd);
+		throw std::runtime_error("Cannot map " + path);
+	}
+	m_data = static_cast<char*>(data);
+}
+
+MappedFile::~MappedFile() {
+	if (m_data != nullptr) {
+		munmap(m_data, m_size);
+	}
+	close(m_fd);
+}
+
+void MappedFile::flush() {
+	msync(m_data, m_size, MS_SYNC);
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-write shared mapping of a file created (or truncated) at a fixed size. Writes go
+// to the page cache and reach the file without passing through the process heap.
+// Existing files can also be mapped read-only, pages are then read in as they are touched.
+class MappedFile {
+public:
+    // Throws std::runtime_error when the file cannot be created or mapped
+    MappedFile(const std::string& path, size_t size);
+    // Read-only mapping of an existing file, writing through data() faults. Throws
+    // std::runtime_error when the file cannot be opened or mapped.
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* data() {
+        return m_data;
+    }
+    const char* data() const {
+        return m_data;
+    }
+    size_t size() const {
+        return m_size;
+    }
+
+    // Blocks until every written page is on disk
+    void flush();
+
+private:
+    char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+#endif // MAPPED_FILE_H
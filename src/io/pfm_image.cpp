@@ -0,0 +1,86 @@
+#include "pfm_image.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	bool host_little_endian() {
+		const uint16_t probe = 1;
+		return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+	}
+}
+
+std::string PfmImage::header(int width, int height) {
+	// A negative scale marks little-endian samples
+	std::string text = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n"
+		+ (host_little_endian() ? "-1.0" : "1.0");
+	// Pad the scale with zeros so the samples start 4-byte aligned
+	while ((text.size() + 1) % 4 != 0) {
+		text += '0';
+	}
+	return text + "\n";
+}
+
+PfmImage::PfmImage(const std::string& path, int width, int height)
+	: m_width(width),
+	m_height(height),
+	m_file(path, header(width, height).size() + size_t(width) * size_t(height) * 3 * sizeof(float)) {
+	const std::string text = header(width, height);
+	std::memcpy(m_file.data(), text.data(), text.size());
+	m_pixels = reinterpret_cast<float*>(m_file.data() + text.size());
+}
+
+std::vector<float> PfmImage::read(const std::string& path, int& width, int& height) {
+	const MappedFile file(path);
+	const char* data = file.data();
+	const char* end = data + file.size();
+	// "PF", width, height and scale, each followed by one whitespace character
+	const char* p = data;
+	const auto token = [&]() {
+		while (p < end && std::isspace(static_cast<unsigned char>(*p))) {
+			++p;
+		}
+		const char* start = p;
+		while (p < end && !std::isspace(static_cast<unsigned char>(*p))) {
+			++p;
+		}
+		return std::string(start, p);
+	};
+	const std::string magic = token();
+	const std::string width_text = token();
+	const std::string height_text = token();
+	const std::string scale_text = token();
+	if (magic != "PF" || p == end) {
+		throw std::runtime_error(path + " is not an RGB PFM image");
+	}
+	++p;
+	width = std::atoi(width_text.c_str());
+	height = std::atoi(height_text.c_str());
+	const double scale = std::atof(scale_text.c_str());
+	const size_t count = size_t(std::max(width, 0)) * size_t(std::max(height, 0)) * 3;
+	if (width <= 0 || height <= 0 || scale == 0. || size_t(end - p) < count * sizeof(float)) {
+		throw std::runtime_error(path + " has a corrupt PFM header or is truncated");
+	}
+
+	std::vector<float> pixels(count);
+	const bool swap = (scale < 0.) != host_little_endian();
+	const size_t row_floats = size_t(width) * 3;
+	for (int y = 0; y < height; ++y) {
+		// Rows are stored bottom to top
+		const char* source = p + size_t(height - 1 - y) * row_floats * sizeof(float);
+		float* target = pixels.data() + size_t(y) * row_floats;
+		std::memcpy(target, source, row_floats * sizeof(float));
+		if (swap) {
+			for (size_t i = 0; i < row_floats; ++i) {
+				uint32_t bits;
+				std::memcpy(&bits, &target[i], sizeof(bits));
+				bits = (bits >> 24) | ((bits >> 8) & 0xff00u) | ((bits << 8) & 0xff0000u) | (bits << 24);
+				std::memcpy(&target[i], &bits, sizeof(bits));
+			}
+		}
+	}
+	return pixels;
+}
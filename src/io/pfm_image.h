@@ -0,0 +1,44 @@
+#ifndef PFM_IMAGE_H
+#define PFM_IMAGE_H
+
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+// RGB Portable Float Map ("PF") written in place through a file mapping, so an image of
+// any size can be filled tile by tile without holding it in memory. PFM stores rows
+// bottom to top, pixel() hides that.
+class PfmImage {
+public:
+    PfmImage(const std::string& path, int width, int height);
+
+    int width() const {
+        return m_width;
+    }
+    int height() const {
+        return m_height;
+    }
+
+    // Three floats for the pixel at column x, row y counted from the top
+    float* pixel(int x, int y) {
+        return m_pixels + (size_t(m_height - 1 - y) * size_t(m_width) + size_t(x)) * 3;
+    }
+
+    void flush() {
+        m_file.flush();
+    }
+
+    // Reads an RGB PFM of either byte order into rows top to bottom, three floats per
+    // pixel. Throws std::runtime_error when path is not one.
+    static std::vector<float> read(const std::string& path, int& width, int& height);
+
+private:
+    static std::string header(int width, int height);
+
+    int m_width;
+    int m_height;
+    MappedFile m_file;
+    float* m_pixels;
+};
+
+#endif // PFM_IMAGE_H
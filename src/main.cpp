@@ -1,5 +1,10 @@
+#include <charconv>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
@@ -7,8 +12,12 @@
 #include "ecs/ECS.h"
 #include "geometry/ray.h"
 #include "geometry/hittable.h"
+#include "geometry/triangle_mesh.h"
 #include "material/material.h"
+#include "motion_system.h"
+#include "obj_file.h"
 #include "render_system.h"
+#include "scene_file.h"
 
 render::Camera create_camera() {
     // image params
@@ -23,32 +32,32 @@ render::Camera create_camera() {
     constexpr point3 lookat = point3(0., 0., 0.);  // Point camera is looking at
     constexpr vec3   vup = vec3(0., 1., 0.);     // Camera-relative "up" direction
 
-    constexpr double defocus_angle = .6;  // Variation angle of rays through each pixel
-    constexpr double focus_dist = 10.;    // Distance from camera lookfrom point to plane of perfect focus
+    constexpr real defocus_angle = .6;  // Variation angle of rays through each pixel
+    constexpr real focus_dist = 10.;    // Distance from camera lookfrom point to plane of perfect focus
 
     const vec3 w = glm::normalize(lookfrom - lookat);
     const vec3 u = glm::normalize(glm::cross(vup, w));
     const vec3 v = glm::cross(w, u);
 
     constexpr auto theta = degrees_to_radians(vfov);
-    const auto h = std::tan(theta / 2);
+    const real h = std::tan(theta / 2);
     auto viewport_height = 2 * h * focus_dist;
 
-    const auto viewport_width = viewport_height * (double(image_width) / image_height);
+    const auto viewport_width = viewport_height * (real(image_width) / image_height);
 
     // Calculate the vectors across the horizontal and down the vertical viewport edges.
     vec3 viewport_u = viewport_width * u;    // Vector across viewport horizontal edge
     vec3 viewport_v = viewport_height * -v;  // Vector down viewport vertical edge
 
     // Calculate the horizontal and vertical delta vectors from pixel to pixel.
-    const auto pixel_delta_u = viewport_u * (1.0 / image_width);
-    const auto pixel_delta_v = viewport_v * (1.0 / image_height);
+    const auto pixel_delta_u = viewport_u * (real(1) / real(image_width));
+    const auto pixel_delta_v = viewport_v * (real(1) / real(image_height));
 
     // Calculate the location of the upper left pixel.
-    const auto viewport_upper_left = lookfrom - (focus_dist * w) - viewport_u / 2. - viewport_v / 2.;
-    const auto pixel00_loc = viewport_upper_left + 0.5 * (pixel_delta_u + pixel_delta_v);
+    const auto viewport_upper_left = lookfrom - (focus_dist * w) - viewport_u / real(2) - viewport_v / real(2);
+    const auto pixel00_loc = viewport_upper_left + real(0.5) * (pixel_delta_u + pixel_delta_v);
 
-    const auto defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2));
+    const real defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2));
     const auto defocus_disk_u = u * defocus_radius;
     const auto defocus_disk_v = v * defocus_radius;
 
@@ -71,28 +80,12 @@ render::Camera create_camera() {
 }
 
 
-int main() {
-    ECS ecs;
-
-    ecs.registerComponent<render::Sphere>();
-    ecs.registerComponent<render::Material>();
-
-    auto& renderSystem = ecs.registerSystem<render::RenderSystem>();
-
-    Signature renderSignature;
-    renderSignature.set(ecs.getComponentType<render::Sphere>());
-    renderSignature.set(ecs.getComponentType<render::Material>());
-
-    ecs.setSystemSignature<render::RenderSystem>(renderSignature);
-
-    EntityManager entityManager;
-
+// The spheres of Ray Tracing in One Weekend's final scene, the diffuse ones rising
+void create_scene(ECS& ecs, RNG& rng) {
     const Entity ground = ecs.createEntity();
     ecs.addComponent(ground, render::Sphere{ {0., -1000., 0.}, 1000. });
     ecs.addComponent(ground, render::Material{ {0.5, 0.5, 0.5}, 0., 0. });
 
-    RNG rng = RNG(3);
-
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
             auto choose_mat = rng.random_double();
@@ -112,7 +105,7 @@ int main() {
                 else if (choose_mat < 0.95) {
                     // metal
                     const color albedo = random_vec3(rng);
-                    const auto fuzz = rng.random_double(0, 0.5);
+                    const real fuzz = rng.random_double(0, 0.5);
                     ecs.addComponent(sphere, render::Sphere{ center, 0.2 });
                     ecs.addComponent(sphere, render::Material{ albedo, 1. , 0., fuzz });
                 }
@@ -136,18 +129,223 @@ int main() {
     const Entity thirdSphere = ecs.createEntity();
     ecs.addComponent(thirdSphere, render::Sphere{ {4., 1., 0.}, {1.} });
     ecs.addComponent(thirdSphere, render::Material{ {0.7, 0.6, 0.5}, 1. , 0., 0. });
+}
+
+// Whole of text as a decimal int
+bool parse_int(const char* text, int& value) {
+    const char* end = text + std::strlen(text);
+    const auto result = std::from_chars(text, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+// The synopsis below, for bad command lines
+void print_usage(const char* program) {
+    std::cerr << "usage: " << program << " [--spp N] [--frames N] [--checkpoint path | --resume path] [--scene path]\n"
+        << "    [--obj path]... [--denoise] [--aux] [--reference path.pfm] [--no-roulette]\n"
+        << "    [--sampler random|sobol|bluenoise] [--stats path.json] [--trace path.json] [output.pfm]\n"
+        << "  or: " << program << " --convert scene.txt scene.bin" << std::endl;
+}
+
+// Usage: cpprtw [--spp N] [--frames N] [--checkpoint path | --resume path] [--scene path] [--obj path]...
+//               [--denoise] [--aux] [--reference path.pfm] [--no-roulette]
+//               [--sampler random|sobol|bluenoise] [--stats path.json] [--trace path.json] [output.pfm]
+//        cpprtw --convert scene.txt scene.bin
+// --spp and --frames take counts of at least 1.
+// With an output path the image is streamed to a PFM file tile by tile instead of being
+// held in memory and saved as dummy.hdr. --checkpoint saves the render's progress to path
+// as it goes, --resume continues (or, with a higher --spp, extends) the one saved there.
+// --frames renders an animation of the moving spheres to frame_0000.hdr, frame_0001.hdr, ...
+// --scene renders the spheres of a binary scene file instead of the built-in scene,
+// --convert writes one from the text format described in scene_file.h.
+// --obj adds the triangles of a Wavefront OBJ file to the scene, in a diffuse grey.
+// --denoise filters the image guided by the first-hit albedo, normal and depth, --aux
+// saves those as albedo.hdr, normal.hdr (components mapped from [-1, 1] to [0, 1]) and
+// depth.hdr. --reference scores the image, before and after denoising, against a
+// high-spp render of the same view, e.g. one streamed by cpprtw --spp 4096 reference.pfm.
+// --no-roulette traces every path until it escapes or reaches the camera's max_depth.
+// --sampler picks where the path's numbers come from, see sampler.h; sobol by default.
+// --stats writes the render's counters as JSON, --trace a Chrome trace of its tiles.
+int main(int argc, char** argv) {
+    ECS ecs;
+
+    ecs.registerComponent<render::Sphere>();
+    ecs.registerComponent<render::Material>();
+    ecs.registerGroup<render::Sphere, render::Material>();
+    ecs.registerComponent<render::TriangleMesh>();
+
+    auto& renderSystem = ecs.registerSystem<render::RenderSystem>("RenderSystem");
+
+    Signature renderSignature;
+    renderSignature.set(ecs.getComponentType<render::Sphere>());
+    renderSignature.set(ecs.getComponentType<render::Material>());
+
+    ecs.setSystemSignature<render::RenderSystem>(renderSignature);
+    ecs.setSystemAccess<render::RenderSystem>(renderSignature, Signature{});
+
+    ecs.registerSystem<render::MotionSystem>("MotionSystem");
+    const Signature motionSignature = ecs.componentSignature<render::Sphere>();
+    ecs.setSystemSignature<render::MotionSystem>(motionSignature);
+    ecs.setSystemAccess<render::MotionSystem>(Signature{}, motionSignature);
 
     const int channels = 3; // RGB
 
     render::Camera cam = create_camera();
+    int frames = 0;
+    std::string scene_path;
+    std::vector<std::string> obj_paths;
+    bool save_auxiliary = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--spp" && i + 1 < argc && parse_int(argv[i + 1], cam.samples_per_pixel) && cam.samples_per_pixel >= 1) {
+            ++i;
+        }
+        else if (arg == "--frames" && i + 1 < argc && parse_int(argv[i + 1], frames) && frames >= 1) {
+            ++i;
+        }
+        else if ((arg == "--checkpoint" || arg == "--resume") && i + 1 < argc) {
+            renderSystem.settings.checkpoint_path = argv[++i];
+            renderSystem.settings.resume = arg == "--resume";
+        }
+        else if (arg == "--scene" && i + 1 < argc) {
+            scene_path = argv[++i];
+        }
+        else if (arg == "--obj" && i + 1 < argc) {
+            obj_paths.push_back(argv[++i]);
+        }
+        else if (arg == "--denoise") {
+            renderSystem.settings.denoise = true;
+        }
+        else if (arg == "--aux") {
+            save_auxiliary = true;
+        }
+        else if (arg == "--reference" && i + 1 < argc) {
+            renderSystem.settings.reference_path = argv[++i];
+        }
+        else if (arg == "--stats" && i + 1 < argc) {
+            renderSystem.settings.stats_path = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            renderSystem.settings.trace_path = argv[++i];
+        }
+        else if (arg == "--no-roulette") {
+            renderSystem.settings.russian_roulette = false;
+        }
+        else if (arg == "--sampler" && i + 1 < argc) {
+            const std::string sampler = argv[++i];
+            if (sampler == "random") {
+                renderSystem.settings.sampler = render::SamplerKind::Random;
+            }
+            else if (sampler == "sobol") {
+                renderSystem.settings.sampler = render::SamplerKind::Sobol;
+            }
+            else if (sampler == "bluenoise") {
+                renderSystem.settings.sampler = render::SamplerKind::BlueNoise;
+            }
+            else {
+                std::cerr << "Unknown sampler " << sampler << ", expected random, sobol or bluenoise" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--convert" && i + 2 < argc) {
+            try {
+                render::SceneFile::convert(argv[i + 1], argv[i + 2]);
+            }
+            catch (const std::runtime_error& error) {
+                std::cerr << error.what() << std::endl;
+                return 1;
+            }
+            std::clog << "Converted " << argv[i + 1] << " to " << argv[i + 2] << std::endl;
+            return 0;
+        }
+        else if (arg.rfind("--", 0) == 0 || !renderSystem.settings.output_path.empty()) {
+            // An unknown option, an option missing its value or given a bad one, or a second
+            // output path
+            std::cerr << (arg.rfind("--", 0) == 0 ? "Unknown option, or missing or invalid value: " : "Unexpected argument: ")
+                << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+        else {
+            renderSystem.settings.output_path = arg;
+        }
+    }
+
+    if (frames > 0 && (!renderSystem.settings.output_path.empty() || !renderSystem.settings.checkpoint_path.empty())) {
+        std::cerr << "--frames writes frame_NNNN.hdr files and cannot be combined with an output path, --checkpoint or --resume" << std::endl;
+        return 1;
+    }
+
+    RNG rng = RNG(3);
+    if (scene_path.empty()) {
+        create_scene(ecs, rng);
+    }
+    else {
+        try {
+            const auto load_start = std::chrono::high_resolution_clock::now();
+            const render::SceneFile scene(scene_path);
+            scene.load(ecs, renderSystem.thread_pool());
+            const auto load_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - load_start);
+            std::clog << "Loaded " << scene.size() << " spheres from " << scene_path << " in " << load_ms.count() << "ms" << std::endl;
+        }
+        catch (const std::runtime_error& error) {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    }
+    for (const std::string& obj_path : obj_paths) {
+        try {
+            const auto load_start = std::chrono::high_resolution_clock::now();
+            render::TriangleMesh mesh{ std::make_shared<const render::MeshBuffers>(render::load_obj(obj_path, renderSystem.thread_pool())) };
+            const auto load_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - load_start);
+            std::clog << "Loaded " << mesh.triangle_count() << " triangles from " << obj_path << " in " << load_ms.count() << "ms" << std::endl;
+            const Entity entity = ecs.createEntity();
+            ecs.addComponent(entity, mesh);
+            ecs.addComponent(entity, render::Material{ {0.5, 0.5, 0.5}, 0., 0. });
+        }
+        catch (const std::runtime_error& error) {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (frames > 0) {
+        bool saved = true;
+        try {
+            renderSystem.render_animation(ecs, cam, rng, frames, [&](int frame, const std::vector<float>& image) {
+                char path[64];
+                std::snprintf(path, sizeof(path), "../../frame_%04d.hdr", frame);
+                if (!stbi_write_hdr(path, cam.width, cam.height, channels, image.data())) {
+                    std::cerr << "Failed to save " << path << "!" << std::endl;
+                    saved = false;
+                }
+                });
+        }
+        catch (const std::runtime_error& error) {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+        return saved ? 0 : 1;
+    }
 
     auto t1 = std::chrono::high_resolution_clock::now();
-    const auto image = renderSystem.render_ecs(ecs, cam, rng);
+    std::vector<float> image;
+    render::AuxiliaryBuffers auxiliary;
+    try {
+        image = renderSystem.render_ecs(ecs, cam, rng, save_auxiliary ? &auxiliary : nullptr);
+    }
+    catch (const std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
     auto t2 = std::chrono::high_resolution_clock::now();
     auto sec = std::chrono::duration_cast<std::chrono::seconds>(t2 - t1);
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
 
     std::clog << "render took " << sec.count() << "s " << (ms - sec).count() << "ms" << std::endl;
+    if (!renderSystem.settings.output_path.empty()) {
+        std::clog << "Streamed " << renderSystem.settings.output_path << " successfully!" << std::endl;
+        return 0;
+    }
     std::clog << "Image data created successfully!" << std::endl;
 
     if (stbi_write_hdr("../../dummy.hdr", cam.width, cam.height, channels, image.data())) {
@@ -158,6 +356,20 @@ int main() {
         return 1;
     }
 
+    if (save_auxiliary) {
+        std::vector<float> normal(auxiliary.normal.size());
+        for (size_t i = 0; i < normal.size(); ++i) {
+            normal[i] = 0.5f * auxiliary.normal[i] + 0.5f;
+        }
+        if (!stbi_write_hdr("../../albedo.hdr", cam.width, cam.height, channels, auxiliary.albedo.data())
+            || !stbi_write_hdr("../../normal.hdr", cam.width, cam.height, channels, normal.data())
+            || !stbi_write_hdr("../../depth.hdr", cam.width, cam.height, 1, auxiliary.depth.data())) {
+            std::cerr << "Failed to save the auxiliary buffers!" << std::endl;
+            return 1;
+        }
+        std::clog << "Saved albedo.hdr, normal.hdr and depth.hdr successfully!" << std::endl;
+    }
+
     return 0;
 
 }
\ No newline at end of file
@@ -6,10 +6,10 @@
 namespace render {
   struct Material {
     color albedo;
-    double metallic;
-    double dielectric;
-    double fuzz = 0.;
-    double refraction_index = 1.;
+    real metallic;
+    real dielectric;
+    real fuzz = 0.;
+    real refraction_index = 1.;
   };
 
 }
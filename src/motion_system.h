@@ -0,0 +1,23 @@
+#ifndef MOTION_SYSTEM_H
+#define MOTION_SYSTEM_H
+
+#include "ecs/ECS.h"
+#include "geometry/hittable.h"
+
+namespace render {
+
+    // Advances every Sphere by one animation frame. A frame spans the ray time range
+    // [0, 1), over which a sphere sweeps its direction, so the next frame starts one
+    // direction further on. Register with the Sphere signature and Sphere write access.
+    class MotionSystem :public System {
+    public:
+        void update(ECS& ecs) override {
+            for (const Entity entity : entities) {
+                Sphere& sphere = ecs.getComponent<Sphere>(entity);
+                sphere.center += sphere.direction;
+            }
+        }
+    };
+
+}
+#endif // MOTION_SYSTEM_H
@@ -0,0 +1,198 @@
+#include "obj_file.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include "io/mapped_file.h"
+
+namespace render {
+
+	namespace {
+		// Bytes per parse task, each chunk runs on to the end of the line it stops in
+		constexpr size_t CHUNK_BYTES = size_t(1) << 20;
+
+		// What one chunk holds. Positive face indices are absolute, negative ones are only
+		// known relative to the chunk's first vertex until the chunks before it are counted.
+		struct Chunk {
+			Chunk(const char* begin, const char* end) : begin(begin), end(end) {}
+
+			const char* begin;
+			const char* end;
+			std::vector<point3> positions;
+			std::vector<int64_t> corners; // Three per triangle, zero-based
+			std::vector<size_t> relative; // Corners still missing the chunk's first vertex
+			const char* error_at = nullptr;
+			std::string error;
+		};
+
+		struct Corner {
+			int64_t index; // Zero-based, from the chunk's first vertex when relative
+			bool relative;
+		};
+
+		bool is_blank(char c) {
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		const char* skip_blanks(const char* p, const char* end) {
+			while (p < end && is_blank(*p)) {
+				++p;
+			}
+			return p;
+		}
+
+		const char* line_end(const char* p, const char* end) {
+			const void* newline = std::memchr(p, '\n', size_t(end - p));
+			return newline ? static_cast<const char*>(newline) : end;
+		}
+
+		bool parse_real(const char*& p, const char* end, double& value) {
+			p = skip_blanks(p, end);
+			if (p < end && *p == '+') {
+				++p;
+			}
+			const auto result = std::from_chars(p, end, value);
+			if (result.ec != std::errc()) {
+				return false;
+			}
+			p = result.ptr;
+			return true;
+		}
+
+		// Parses the statements of [chunk.begin, chunk.end). Stops at the first malformed
+		// one and records it.
+		void parse_chunk(Chunk& chunk) {
+			const char* end = chunk.end;
+			const auto fail = [&](const char* at, const char* message) {
+				chunk.error_at = at;
+				chunk.error = message;
+			};
+			for (const char* line = chunk.begin; line < end; ) {
+				const char* eol = line_end(line, end);
+				const char* p = skip_blanks(line, eol);
+				const char* statement = p;
+				const char* next_line = eol < end ? eol + 1 : end;
+				if (p + 1 < eol && p[0] == 'v' && is_blank(p[1])) {
+					double x, y, z;
+					++p;
+					if (!parse_real(p, eol, x) || !parse_real(p, eol, y) || !parse_real(p, eol, z)) {
+						fail(statement, "expected three vertex coordinates");
+						return;
+					}
+					chunk.positions.push_back(point3(x, y, z));
+				}
+				else if (p + 1 < eol && p[0] == 'f' && is_blank(p[1])) {
+					// Fan around the first corner: (0, 1, 2), (0, 2, 3), ...
+					Corner first{}, previous{};
+					int corner_count = 0;
+					++p;
+					while (true) {
+						p = skip_blanks(p, eol);
+						if (p == eol) {
+							break;
+						}
+						int64_t index;
+						const auto result = std::from_chars(p, eol, index);
+						if (result.ec != std::errc() || index == 0) {
+							fail(statement, "expected a nonzero vertex index");
+							return;
+						}
+						p = result.ptr;
+						// Texture and normal indices
+						while (p < eol && !is_blank(*p)) {
+							++p;
+						}
+						const Corner corner = index < 0
+							? Corner{ int64_t(chunk.positions.size()) + index, true }
+							: Corner{ index - 1, false };
+						if (corner_count >= 2) {
+							for (const Corner& c : { first, previous, corner }) {
+								if (c.relative) {
+									chunk.relative.push_back(chunk.corners.size());
+								}
+								chunk.corners.push_back(c.index);
+							}
+						}
+						if (corner_count == 0) {
+							first = corner;
+						}
+						previous = corner;
+						++corner_count;
+					}
+					if (corner_count < 3) {
+						fail(statement, "a face needs at least three vertices");
+						return;
+					}
+				}
+				line = next_line;
+			}
+		}
+	}
+
+	MeshBuffers load_obj(const std::string& path, ThreadPool& pool) {
+		const MappedFile file(path);
+		const char* data = file.data();
+		const char* data_end = data + file.size();
+
+		std::vector<Chunk> chunks;
+		for (const char* begin = data; begin < data_end; ) {
+			const char* end = begin + std::min(CHUNK_BYTES, size_t(data_end - begin));
+			if (end < data_end) {
+				end = line_end(end, data_end);
+				end = end < data_end ? end + 1 : end;
+			}
+			chunks.emplace_back(begin, end);
+			begin = end;
+		}
+		pool.parallel_for(chunks.size(), [&](size_t i) {
+			parse_chunk(chunks[i]);
+			});
+
+		for (const Chunk& chunk : chunks) {
+			if (chunk.error_at) {
+				const size_t line = 1 + size_t(std::count(data, chunk.error_at, '\n'));
+				throw std::runtime_error(path + ":" + std::to_string(line) + ": " + chunk.error);
+			}
+		}
+
+		// Each chunk's vertices and corners start where the previous chunk's end
+		std::vector<size_t> vertex_base(chunks.size() + 1, 0);
+		std::vector<size_t> corner_base(chunks.size() + 1, 0);
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			vertex_base[i + 1] = vertex_base[i] + chunks[i].positions.size();
+			corner_base[i + 1] = corner_base[i] + chunks[i].corners.size();
+		}
+		const size_t vertex_count = vertex_base.back();
+		if (vertex_count > std::numeric_limits<uint32_t>::max()) {
+			throw std::runtime_error(path + " has more vertices than a mesh can index");
+		}
+
+		MeshBuffers mesh;
+		mesh.positions.resize(vertex_count);
+		mesh.indices.resize(corner_base.back());
+		std::vector<char> out_of_range(chunks.size(), 0);
+		pool.parallel_for(chunks.size(), [&](size_t i) {
+			Chunk& chunk = chunks[i];
+			for (const size_t corner : chunk.relative) {
+				chunk.corners[corner] += int64_t(vertex_base[i]);
+			}
+			std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + vertex_base[i]);
+			uint32_t* indices = mesh.indices.data() + corner_base[i];
+			for (size_t k = 0; k < chunk.corners.size(); ++k) {
+				const int64_t corner = chunk.corners[k];
+				out_of_range[i] |= corner < 0 || corner >= int64_t(vertex_count);
+				indices[k] = uint32_t(corner);
+			}
+			// Release the chunk's copies as soon as they are merged
+			chunk.positions = {};
+			chunk.corners = {};
+			});
+		if (std::find(out_of_range.begin(), out_of_range.end(), 1) != out_of_range.end()) {
+			throw std::runtime_error(path + " has a face referring to a vertex it does not define");
+		}
+		return mesh;
+	}
+
+}
@@ -0,0 +1,21 @@
+#ifndef OBJ_FILE_H
+#define OBJ_FILE_H
+
+#include <string>
+#include "geometry/triangle_mesh.h"
+#include "thread_pool.h"
+
+namespace render {
+
+    // Reads the vertex positions and faces of a Wavefront OBJ file into one mesh. Faces
+    // with more than three corners are split into a fan, texture and normal indices
+    // (f 1/2/3 ...) and every other statement (vt, vn, o, g, usemtl, ...) are skipped.
+    // Negative indices count back from the last vertex read, as the format specifies.
+    //
+    // The file is memory-mapped and cut into chunks at line breaks that are parsed in
+    // parallel on pool straight from the mapping, so no line is copied into a string.
+    // Throws std::runtime_error naming the path and line of the first malformed statement.
+    MeshBuffers load_obj(const std::string& path, ThreadPool& pool);
+
+}
+#endif // OBJ_FILE_H
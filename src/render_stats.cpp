@@ -0,0 +1,89 @@
+#include "render_stats.h"
+
+namespace render {
+
+	uint64_t RenderStats::pixels_done() const {
+		uint64_t done = 0;
+		for (const ThreadCounters& counters : threads) {
+			done += counters.pixels_done.load(std::memory_order_relaxed);
+		}
+		return done;
+	}
+
+	void RenderStats::write_json(std::ostream& out) const {
+		uint64_t rays = 0, packet_rays = 0, intersection_tests = 0, depth_terminated = 0, roulette_terminated = 0, tiles = 0, samples = 0;
+		uint64_t path_bounces = 0;
+		uint64_t scatters[3] = {};
+		uint64_t bounce_histogram[ThreadCounters::BOUNCE_BINS] = {};
+		for (const ThreadCounters& counters : threads) {
+			rays += counters.rays;
+			packet_rays += counters.packet_rays;
+			intersection_tests += counters.intersection_tests;
+			depth_terminated += counters.depth_terminated;
+			roulette_terminated += counters.roulette_terminated;
+			path_bounces += counters.path_bounces;
+			tiles += counters.tiles.size();
+			samples += counters.samples;
+			for (int kind = 0; kind < 3; ++kind) {
+				scatters[kind] += counters.scatters[kind];
+			}
+			for (int bin = 0; bin < ThreadCounters::BOUNCE_BINS; ++bin) {
+				bounce_histogram[bin] += counters.bounce_histogram[bin];
+			}
+		}
+
+		out << "{\n";
+		out << "  \"seconds\": " << seconds << ",\n";
+		out << "  \"samples\": " << samples << ",\n";
+		out << "  \"rays\": " << rays << ",\n";
+		out << "  \"rays_per_second\": " << (seconds > 0. ? double(rays) / seconds : 0.) << ",\n";
+		out << "  \"packet_rays\": " << packet_rays << ",\n";
+		out << "  \"intersection_tests\": " << intersection_tests << ",\n";
+		out << "  \"depth_terminated\": " << depth_terminated << ",\n";
+		out << "  \"roulette_terminated\": " << roulette_terminated << ",\n";
+		out << "  \"tiles\": " << tiles << ",\n";
+		out << "  \"scatters\": {\"lambertian\": " << scatters[0] << ", \"metallic\": " << scatters[1]
+			<< ", \"dielectric\": " << scatters[2] << "},\n";
+		uint64_t paths = 0;
+		out << "  \"bounce_histogram\": [";
+		for (int bin = 0; bin < ThreadCounters::BOUNCE_BINS; ++bin) {
+			out << (bin > 0 ? ", " : "") << bounce_histogram[bin];
+			paths += bounce_histogram[bin];
+		}
+		out << "],\n";
+		out << "  \"mean_path_length\": " << (paths > 0 ? double(path_bounces) / double(paths) : 0.) << ",\n";
+		const auto write_error = [&](const char* name, const std::optional<ImageError>& score) {
+			if (score) {
+				out << "  \"" << name << "\": {\"rmse\": " << score->rmse << ", \"rel_mse\": " << score->rel_mse
+					<< ", \"psnr\": " << score->psnr << "},\n";
+			}
+		};
+		if (denoise_seconds > 0.) {
+			out << "  \"denoise_seconds\": " << denoise_seconds << ",\n";
+		}
+		write_error("error", error);
+		write_error("denoised_error", denoised_error);
+		out << "  \"rays_per_thread\": [";
+		for (size_t t = 0; t < threads.size(); ++t) {
+			out << (t > 0 ? ", " : "") << threads[t].rays;
+		}
+		out << "]\n}\n";
+	}
+
+	void RenderStats::write_trace(std::ostream& out) const {
+		out << "{\"traceEvents\": [\n";
+		bool first = true;
+		for (size_t t = 0; t < threads.size(); ++t) {
+			for (const TileEvent& tile : threads[t].tiles) {
+				out << (first ? "" : ",\n") << "{\"name\": \"tile " << tile.i0 << "," << tile.j0
+					<< "\", \"cat\": \"render\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << t
+					<< ", \"ts\": " << tile.start_us << ", \"dur\": " << tile.duration_us
+					<< ", \"args\": {\"x0\": " << tile.i0 << ", \"x1\": " << tile.i1
+					<< ", \"y0\": " << tile.j0 << ", \"y1\": " << tile.j1 << "}}";
+				first = false;
+			}
+		}
+		out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+	}
+
+}
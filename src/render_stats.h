@@ -0,0 +1,91 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+namespace render {
+
+    // Wall time of one tile, relative to the start of the render
+    struct TileEvent {
+        int i0, i1, j0, j1;
+        double start_us;
+        double duration_us;
+    };
+
+    // Counters owned by one render thread. Only the owner writes them, so the hot path
+    // uses plain increments and nothing is shared until the render is over. The struct is
+    // cache line aligned so neighbouring threads never write the same line.
+    struct alignas(64) ThreadCounters {
+        static constexpr int BOUNCE_BINS = 32; // The last bin also collects longer paths
+
+        uint64_t rays = 0; // Closest-hit queries, one per path segment
+        uint64_t packet_rays = 0; // Camera rays whose first hit was found by a coherent packet
+        uint64_t intersection_tests = 0; // Ray-primitive tests run by the BVH leaves
+        uint64_t depth_terminated = 0; // Paths cut off by the bounce limit
+        uint64_t roulette_terminated = 0; // Paths ended by Russian roulette
+        uint64_t path_bounces = 0; // Bounces summed over every path, for the mean path length
+        uint64_t scatters[3] = {}; // Indexed by ScatterKind
+        uint64_t bounce_histogram[BOUNCE_BINS] = {}; // Paths by number of bounces
+        uint64_t samples = 0; // Camera samples taken by this render
+        int min_pixel_samples = INT_MAX; // Fewest and most samples any one pixel has
+        int max_pixel_samples = 0;
+        std::vector<TileEvent> tiles;
+        // Read by the progress thread while the render runs. The owner stores with relaxed
+        // order, a plain move on x86, instead of a locked read-modify-write.
+        std::atomic<uint64_t> pixels_done = 0;
+
+        void record_path(int bounces) {
+            path_bounces += uint64_t(bounces);
+            ++bounce_histogram[bounces < BOUNCE_BINS ? bounces : BOUNCE_BINS - 1];
+        }
+
+        void record_pixel(int pixel_samples) {
+            min_pixel_samples = pixel_samples < min_pixel_samples ? pixel_samples : min_pixel_samples;
+            max_pixel_samples = pixel_samples > max_pixel_samples ? pixel_samples : max_pixel_samples;
+        }
+
+        void add_pixels(uint64_t count) {
+            pixels_done.store(pixels_done.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        }
+    };
+
+    // Difference of a frame from a reference render of the same view
+    struct ImageError {
+        double rmse = 0.; // Root mean squared error over every channel
+        double rel_mse = 0.; // Squared error over reference^2 + 0.01, so dark regions count alike
+        double psnr = 0.; // Decibels against a peak of 1, the brightest resolved value
+    };
+
+    // Per-thread counters of one render, summed only for the report
+    struct RenderStats {
+        explicit RenderStats(size_t thread_count) : threads(thread_count) {}
+
+        std::vector<ThreadCounters> threads;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double seconds = 0.; // Wall time of the whole render
+        double denoise_seconds = 0.; // Wall time of the denoising pass, when there is one
+        // Scores against RenderSettings::reference_path, before and after denoising
+        std::optional<ImageError> error;
+        std::optional<ImageError> denoised_error;
+
+        // Safe to call while the render runs
+        uint64_t pixels_done() const;
+
+        double since_start_us() const {
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // Totals plus the per-thread ray counts
+        void write_json(std::ostream& out) const;
+        // Chrome trace event format (chrome://tracing, Perfetto), one slice per tile
+        void write_trace(std::ostream& out) const;
+    };
+
+}
+#endif // RENDER_STATS_H
@@ -1,14 +1,63 @@
 #include "common.h"
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
-#include <thread>
 #include "ecs/entity.h"
 #include "render_system.h"
 #include "camera.h"
 #include "geometry/interval.h"
+#include "checkpoint.h"
+#include "io/pfm_image.h"
 #include "material/material.h"
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 namespace render {
 
+	namespace {
+		// Every other bit of v, from bit 0, packed together: one coordinate of a Morton code
+		uint32_t compact_bits(uint32_t v) {
+			v &= 0x55555555u;
+			v = (v | (v >> 1)) & 0x33333333u;
+			v = (v | (v >> 2)) & 0x0f0f0f0fu;
+			v = (v | (v >> 4)) & 0x00ff00ffu;
+			v = (v | (v >> 8)) & 0x0000ffffu;
+			return v;
+		}
+
+		// Calls visit(x, y) for every cell of a columns x rows grid in the given order. The
+		// Z-order curve runs over the enclosing power of two square and skips cells outside.
+		template <typename Fn>
+		void for_each_cell(int columns, int rows, PixelOrder order, Fn&& visit) {
+			if (order == PixelOrder::Scanline) {
+				for (int y = 0; y < rows; ++y) {
+					for (int x = 0; x < columns; ++x) {
+						visit(x, y);
+					}
+				}
+				return;
+			}
+			uint32_t side = 1;
+			while (side < uint32_t(columns) || side < uint32_t(rows)) {
+				side <<= 1;
+			}
+			for (uint32_t code = 0; code < side * side; ++code) {
+				const int x = int(compact_bits(code));
+				const int y = int(compact_bits(code >> 1));
+				if (x < columns && y < rows) {
+					visit(x, y);
+				}
+			}
+		}
+
+		// Dimension of each bounce's stream that decides Russian roulette. The scatter
+		// functions never draw that far, so the decision leaves their numbers unchanged.
+		constexpr uint32_t ROULETTE_DIMENSION = 1u << 16;
+	}
+
 	std::optional<HitRecord> RenderSystem::hit_sphere(const Sphere& sphere, const Ray& r, Interval ray_t) const {
 		const vec3 current_center = sphere.center + sphere.direction * r.time;
 		const vec3 oc = current_center - r.origin;
@@ -42,7 +91,7 @@ namespace render {
 		if (near_zero(scatter_direction)) {
 			scatter_direction = rec.normal;
 		}
-		return r.scattered(offset(rec.p, scatter_direction, 1e-3), scatter_direction, r.attenuation * mat.albedo);
+		return r.scattered(offset(rec.p, rec.normal, 1e-3), scatter_direction, r.attenuation * mat.albedo);
 	}
 
 	std::optional<Ray> RenderSystem::scatter_metallic(const Material& mat, const Ray& r, const HitRecord& rec, RNG& rng) const {
@@ -51,195 +100,830 @@ namespace render {
 		if (glm::dot(reflected, rec.normal) < 0) {
 			return {};
 		}
-		return r.scattered(offset(rec.p, reflected, 1e-3), reflected, r.attenuation * mat.albedo);
+		return r.scattered(offset(rec.p, rec.normal, 1e-3), reflected, r.attenuation * mat.albedo);
 	}
 
 	std::optional<Ray> RenderSystem::scatter_dielectric(const Material& mat, const Ray& r, const HitRecord& rec, RNG& rng) const {
-		double cos_theta = std::fmin(glm::dot(-glm::normalize(r.direction), rec.normal), 1.0);
-		double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
-		const double ri = rec.front_face ? (1.0 / mat.refraction_index) : mat.refraction_index;
+		real cos_theta = std::min(glm::dot(-glm::normalize(r.direction), rec.normal), real(1));
+		real sin_theta = std::sqrt(1 - cos_theta * cos_theta);
+		const real ri = rec.front_face ? (1 / mat.refraction_index) : mat.refraction_index;
 		vec3 direction;
 		vec3 p;
-		if (ri * sin_theta > 1. || reflectance(cos_theta, ri) > rng.random_double()) {
+		if (ri * sin_theta > 1. || reflectance(cos_theta, ri) > rng.random_real()) {
 			direction = reflect(r.direction, rec.normal);
-			p = offset(rec.p, direction, 1e-3);
+			p = offset(rec.p, rec.normal, 1e-3);
 		}
 		else {
 			direction = refract(glm::normalize(r.direction), rec.normal, ri);
-			p = offset(rec.p, direction, 1e-3);//rec.p - rec.normal * 1e-5;
+			p = offset(rec.p, -rec.normal, 1e-3);
 		}
 
 		return r.scattered(p, direction, r.attenuation);//Ray(p,direction,r.attenuation,r.index,0);
 	}
 
-	std::optional<Ray> RenderSystem::scatter(ECS& ecs, const Ray& r, const HitRecord& rec, RNG& rng) const {
-		const double t = rng.random_double();
-		const double s = rng.random_double();
-		// TODO: Probably expensive to search for the associated material at each hit,
-		// allow sphere to have material directly?
-		const auto& mat = ecs.getComponent<Material>(rec.entity);
+	ScatterKind RenderSystem::choose_scatter(const Material& mat, RNG& rng) const {
+		const real t = rng.random_real();
+		const real s = rng.random_real();
 		if (t > mat.metallic) {
 			if (s > mat.dielectric) {
-				return scatter_lambertian(mat, r, rec, rng);
+				return ScatterKind::Lambertian;
 			}
+			return ScatterKind::Dielectric;
+		}
+		return ScatterKind::Metallic;
+	}
+
+	std::optional<Ray> RenderSystem::scatter(const SceneSnapshot& scene, const Ray& r, const HitRecord& rec, RNG& rng, ThreadCounters& counters) const {
+		const Material& mat = scene.material(rec.material);
+		const ScatterKind kind = choose_scatter(mat, rng);
+		++counters.scatters[size_t(kind)];
+		switch (kind) {
+		case ScatterKind::Lambertian:
+			return scatter_lambertian(mat, r, rec, rng);
+		case ScatterKind::Dielectric:
 			return scatter_dielectric(mat, r, rec, rng);
+		default:
+			return scatter_metallic(mat, r, rec, rng);
+		}
+	}
 
+	bool RenderSystem::survives_roulette(Ray& r, int bounces, RNG& rng, ThreadCounters& counters) const {
+		if (!settings.russian_roulette || bounces < settings.roulette_bounces) {
+			return true;
+		}
+		const real throughput = std::max(r.attenuation.x, std::max(r.attenuation.y, r.attenuation.z));
+		const real survival = std::min(throughput, real(settings.roulette_max_survival));
+		rng.seek_dimension(ROULETTE_DIMENSION);
+		if (!(rng.random_real() < survival)) {
+			++counters.roulette_terminated;
+			return false;
 		}
-		return scatter_metallic(mat, r, rec, rng);
+		r.attenuation /= survival;
+		return true;
 	}
 
+	color RenderSystem::background(const Ray& r) const {
+		const real a = real(0.5) * (glm::normalize(r.direction).y + 1);
+		return (1 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
+	}
 
-	std::optional<HitRecord> RenderSystem::hit(ECS& ecs, const Ray& r, Interval ray_t) const {
-		std::optional<HitRecord> closest_hit;
-		auto closest_so_far = ray_t.max;
-		for (auto entity : entities)
-		{
-			const auto& sphere = ecs.getComponent<Sphere>(entity);
-			const auto hit = hit_sphere(sphere, r, Interval(ray_t.min, closest_so_far));
-			if (hit.has_value() && hit->t < closest_so_far) {
-				closest_hit = hit;
-				closest_hit->entity = entity;
-				closest_so_far = hit->t;
+
+	int64_t RenderSystem::closest_slot(const SceneSnapshot& scene, const Ray& r, Interval ray_t, real& t, ThreadCounters& counters) const {
+		int64_t closest = -1;
+		t = ray_t.max;
+		++counters.rays;
+		const uint32_t static_first = scene.bvh.static_first();
+		scene.bvh.traverse(r, ray_t.min, t, [&](uint32_t first, uint32_t count) {
+			counters.intersection_tests += count;
+			const int64_t slot = first >= static_first
+				? intersect_spheres<false>(scene.spheres, first, count, r, ray_t.min, t)
+				: intersect_spheres<true>(scene.spheres, first, count, r, ray_t.min, t);
+			if (slot >= 0) {
+				closest = slot;
 			}
+			});
+		if (scene.triangles.size() > 0) {
+			const WatertightRay watertight(r);
+			const int64_t triangle_base = int64_t(scene.spheres.size());
+			scene.mesh_bvh.traverse(r, ray_t.min, t, [&](uint32_t first, uint32_t count) {
+				counters.intersection_tests += count;
+				const int64_t slot = intersect_triangles(scene.triangles, first, count, watertight, ray_t.min, t);
+				if (slot >= 0) {
+					closest = triangle_base + slot;
+				}
+				});
+		}
+		return closest;
+	}
+
+	HitRecord RenderSystem::hit_record(const SceneSnapshot& scene, const Ray& r, real t, int64_t slot) const {
+		if (scene.is_triangle(slot)) {
+			const uint32_t triangle = scene.triangle_slot(slot);
+			HitRecord rec{ t, r.at(t), glm::normalize(scene.triangles.normal(triangle)), r };
+			rec.material = scene.triangles.triangles[triangle].material;
+			return rec;
 		}
-		return closest_hit;
+		const point3 current_center = scene.spheres.center(slot, r.time);
+		const point3 point = r.at(t);
+		HitRecord rec{ t, point, (point - current_center) / scene.spheres.radius(slot), r };
+		rec.material = scene.spheres.material[slot];
+		return rec;
+	}
 
+	void RenderSystem::closest_slots(const SceneSnapshot& scene, RayPacket& packet, ThreadCounters& counters) const {
+		if (packet.size < simd::vreal::width || !packet.coherent()) {
+			for (int k = 0; k < packet.size; ++k) {
+				packet.slot[k] = closest_slot(scene, packet.ray(k), Interval(0, infinity), packet.t[k], counters);
+			}
+			return;
+		}
+		counters.rays += uint64_t(packet.size);
+		counters.packet_rays += uint64_t(packet.size);
+		packet.pad(simd::vreal::width);
+		const RayInterval bounds = packet.bounds();
+		real t_max = packet.max_t();
+		scene.bvh.traverse_packet(bounds, 0, t_max, [&](uint32_t first, uint32_t count) {
+			counters.intersection_tests += uint64_t(count) * uint64_t(packet.size);
+			intersect_spheres_packet(scene.spheres, first, count, packet, 0);
+			t_max = packet.max_t();
+			});
+		if (scene.triangles.size() > 0) {
+			WatertightRay watertight[RayPacket::MAX_RAYS];
+			for (int k = 0; k < packet.size; ++k) {
+				watertight[k] = WatertightRay(packet.ray(k));
+			}
+			const int64_t triangle_base = int64_t(scene.spheres.size());
+			scene.mesh_bvh.traverse_packet(bounds, 0, t_max, [&](uint32_t first, uint32_t count) {
+				counters.intersection_tests += uint64_t(count) * uint64_t(packet.size);
+				for (int k = 0; k < packet.size; ++k) {
+					const int64_t slot = intersect_triangles(scene.triangles, first, count, watertight[k], 0, packet.t[k]);
+					if (slot >= 0) {
+						packet.slot[k] = triangle_base + slot;
+					}
+				}
+				t_max = packet.max_t();
+				});
+		}
 	}
 
+	std::optional<HitRecord> RenderSystem::hit(const SceneSnapshot& scene, const Ray& r, Interval ray_t, ThreadCounters& counters) const {
+		real t;
+		const int64_t slot = closest_slot(scene, r, ray_t, t, counters);
+		if (slot < 0) {
+			return {};
+		}
+		return hit_record(scene, r, t, slot);
+	}
 
+	FirstHit RenderSystem::first_hit(const SceneSnapshot& scene, const Ray& r, int64_t slot, real t) const {
+		FirstHit hit;
+		if (slot < 0) {
+			hit.albedo = background(r);
+			return hit;
+		}
+		const HitRecord rec = hit_record(scene, r, t, slot);
+		hit.albedo = scene.material(rec.material).albedo;
+		hit.normal = rec.normal;
+		hit.depth = t * glm::length(r.direction);
+		return hit;
+	}
 
-	void RenderSystem::render_pixel(ECS& ecs, const Camera& cam, int x, int y, std::vector<color>& pixel_colors, RNG& rng) const {
-		for (int sample = 0; sample < cam.samples_per_pixel; ++sample) {
-			Ray r = cam.get_ray(x, y, rng);
-			while (true) {
-				if (r.depth < 0) {
-					break;
-				}
-				const std::optional<HitRecord> closest_hit = hit(ecs, r, Interval(0, infinity));
-				if (closest_hit.has_value()) {
-					const vec3 direction = closest_hit->normal + random_unit_vector(rng);
-					const auto new_ray = scatter(ecs, r, closest_hit.value(), rng);
-					if (new_ray.has_value()) {
-						r = new_ray.value();
-					}
-					else {
-						break;
+	color RenderSystem::trace(const SceneSnapshot& scene, Ray r, RNG& rng, ThreadCounters& counters, FirstHit* first) const {
+		if (r.depth < 0) {
+			++counters.depth_terminated;
+			counters.record_path(0);
+			return color(0., 0., 0.);
+		}
+		real t;
+		const int64_t slot = closest_slot(scene, r, Interval(0, infinity), t, counters);
+		return trace_from(scene, r, slot, t, rng, counters, first);
+	}
+
+	color RenderSystem::trace_from(const SceneSnapshot& scene, Ray r, int64_t slot, real t, RNG& rng, ThreadCounters& counters,
+		FirstHit* first) const {
+		if (first) {
+			*first = first_hit(scene, r, slot, t);
+		}
+		int bounces = 0;
+		while (true) {
+			if (slot < 0) {
+				counters.record_path(bounces);
+				return background(r) * r.attenuation;
+			}
+			rng.next_bounce();
+			const auto new_ray = scatter(scene, r, hit_record(scene, r, t, slot), rng, counters);
+			++bounces;
+			if (!new_ray.has_value()) {
+				counters.record_path(bounces);
+				return color(0., 0., 0.);
+			}
+			r = new_ray.value();
+			if (r.depth < 0) {
+				++counters.depth_terminated;
+				counters.record_path(bounces);
+				return color(0., 0., 0.);
+			}
+			if (!survives_roulette(r, bounces, rng, counters)) {
+				counters.record_path(bounces);
+				return color(0., 0., 0.);
+			}
+			slot = closest_slot(scene, r, Interval(0, infinity), t, counters);
+		}
+	}
+
+	color RenderSystem::sample_pixel(const SceneSnapshot& scene, const Camera& cam, int x, int y, int sample, RNG& rng, ThreadCounters& counters,
+		FirstHit* first) const {
+		rng.seek(uint32_t(y * cam.width + x), uint32_t(sample), 0);
+		return trace(scene, cam.get_ray(x, y, rng), rng, counters, first);
+	}
+
+	bool RenderSystem::pixel_done(const Camera& cam, const PixelStats& stats) const {
+		if (settings.adaptive) {
+			// Keep sampling until the pixel mean is known well enough or the budget runs out
+			const int min_samples = std::max(2, settings.min_samples_per_pixel);
+			return stats.count >= settings.max_samples_per_pixel
+				|| (stats.count >= min_samples && stats.converged(settings.noise_threshold));
+		}
+		return stats.count >= cam.samples_per_pixel;
+	}
+
+	void RenderSystem::render_pixel(const SceneSnapshot& scene, const Camera& cam, int x, int y, TileBuffer& tile, RNG& rng, ThreadCounters& counters) const {
+		const size_t k = tile.index(x, y);
+		PixelStats& stats = tile.stats[k];
+		const bool features = tile.has_auxiliary();
+		while (!pixel_done(cam, stats)) {
+			FirstHit first;
+			const color c = sample_pixel(scene, cam, x, y, stats.count, rng, counters, features ? &first : nullptr);
+			tile.colors[k] += accum_color(c);
+			stats.add(luminance(c));
+			if (features) {
+				tile.add_features(k, first);
+			}
+		}
+	}
+
+	void RenderSystem::render_block(const SceneSnapshot& scene, const Camera& cam, int x0, int y0, int x1, int y1,
+		TileBuffer& tile, RNG& rng, ThreadCounters& counters) const {
+		const bool features = tile.has_auxiliary();
+		RayPacket packet;
+		while (true) {
+			packet.clear();
+			for (int y = y0; y < y1; ++y) {
+				for (int x = x0; x < x1; ++x) {
+					const PixelStats& stats = tile.stats[tile.index(x, y)];
+					if (!pixel_done(cam, stats)) {
+						rng.seek(uint32_t(y * cam.width + x), uint32_t(stats.count), 0);
+						packet.push_back(cam.get_ray(x, y, rng), infinity);
 					}
 				}
-				else {
-					auto a = 0.5 * (glm::normalize(r.direction).y + 1.0);
-					const color background_color = (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
-					pixel_colors[r.index] += background_color * r.attenuation;
-					break;
+			}
+			if (packet.size == 0) {
+				return;
+			}
+			closest_slots(scene, packet, counters);
+			// Each ray goes on from its first hit on the stream sample_pixel would give it
+			for (int k = 0; k < packet.size; ++k) {
+				const Ray r = packet.ray(k);
+				const size_t pixel = tile.index(r.index % cam.width, r.index / cam.width);
+				PixelStats& stats = tile.stats[pixel];
+				rng.seek(uint32_t(r.index), uint32_t(stats.count), 0);
+				FirstHit first;
+				const color c = trace_from(scene, r, packet.slot[k], packet.t[k], rng, counters, features ? &first : nullptr);
+				tile.colors[pixel] += accum_color(c);
+				stats.add(luminance(c));
+				if (features) {
+					tile.add_features(pixel, first);
 				}
 			}
 		}
-
 	}
 
-
-	void RenderSystem::render_tile(int i0, int i1, int j0, int j1,
-		ECS& ecs,
+	void RenderSystem::render_tile(
+		const SceneSnapshot& scene,
 		const Camera& cam,
-		std::vector<color>& pixel_colors,
-		std::atomic<int>& finished_blocklines,
-		ProgressBar& bar,
-		int total_blocklines,
+		TileBuffer& tile,
+		ThreadCounters& counters,
 		RNG thread_rng
 	) const {
-		// const vec3 direction = random_unit_vector(thread_rng);
-
-		for (int j = j0; j < j1; ++j) {
-			for (int i = i0; i < i1; ++i) {
-				for (int sample = 0; sample < cam.samples_per_pixel; ++sample) {
-					Ray r = cam.get_ray(i, j, thread_rng);
-					while (true) {
-						if (r.depth < 0) {
+		thread_rng.use_sampler(settings.sampler, uint32_t(cam.width));
+		uint64_t samples_before = 0;
+		for (const PixelStats& stats : tile.stats) {
+			samples_before += uint64_t(stats.count);
+		}
+
+		if (settings.mode == RenderMode::Wavefront) {
+			render_tile_wavefront(scene, cam, tile, counters, thread_rng);
+			counters.add_pixels(tile.size());
+		}
+		else {
+			// Cells of block x block pixels, single pixels without packets
+			const int block = settings.packet_size > 1 && cam.max_depth >= 0 ? std::min(settings.packet_size, RayPacket::MAX_SIDE) : 1;
+			const int columns = (tile.width + block - 1) / block;
+			const int rows = (tile.height + block - 1) / block;
+			for_each_cell(columns, rows, settings.pixel_order, [&](int column, int row) {
+				const int x0 = tile.i0 + column * block;
+				const int y0 = tile.j0 + row * block;
+				const int x1 = std::min(x0 + block, tile.i0 + tile.width);
+				const int y1 = std::min(y0 + block, tile.j0 + tile.height);
+				if (block == 1) {
+					render_pixel(scene, cam, x0, y0, tile, thread_rng, counters);
+				}
+				else {
+					render_block(scene, cam, x0, y0, x1, y1, tile, thread_rng, counters);
+				}
+				counters.add_pixels(uint64_t(x1 - x0) * uint64_t(y1 - y0));
+				});
+		}
+
+		uint64_t samples_after = 0;
+		for (const PixelStats& stats : tile.stats) {
+			samples_after += uint64_t(stats.count);
+			counters.record_pixel(stats.count);
+		}
+		counters.samples += samples_after - samples_before;
+	}
+
+	void RenderSystem::render_tile_wavefront(
+		const SceneSnapshot& scene,
+		const Camera& cam,
+		TileBuffer& tile,
+		ThreadCounters& counters,
+		RNG& rng
+	) const {
+		const int i0 = tile.i0;
+		const int j0 = tile.j0;
+		const int tile_width = tile.width;
+		const size_t tile_pixels = size_t(tile_width) * size_t(tile.height);
+		std::vector<PackedRay> rays;
+		std::vector<PackedRay> next_rays;
+		std::vector<PackedHit> hits;
+		std::vector<uint32_t> misses;
+		// Hits binned by the scatter function chosen for them
+		std::vector<PackedHit> shade_queues[3];
+		rays.reserve(tile_pixels);
+		next_rays.reserve(tile_pixels);
+		hits.reserve(tile_pixels);
+		misses.reserve(tile_pixels);
+
+		// Rays carry the tile-local pixel index, each pass collects one sample per active
+		// pixel. A pixel's next sample index is its count, pixels may start at any count.
+		std::vector<color> sample_values(tile_pixels);
+		std::vector<uint32_t> active;
+		std::vector<uint32_t> still_active;
+		active.reserve(tile_pixels);
+		for (uint32_t local = 0; local < tile_pixels; ++local) {
+			if (!pixel_done(cam, tile.stats[local])) {
+				active.push_back(local);
+			}
+		}
+		const auto global_pixel = [&](uint32_t local) {
+			return uint32_t((j0 + int(local) / tile_width) * cam.width + i0 + int(local) % tile_width);
+		};
+
+		while (!active.empty()) {
+			// Generate: one camera ray per active pixel of the tile
+			rays.clear();
+			for (const uint32_t local : active) {
+				const int x = i0 + int(local) % tile_width;
+				const int y = j0 + int(local) / tile_width;
+				rng.seek(uint32_t(y * cam.width + x), uint32_t(tile.stats[local].count), 0);
+				Ray r = cam.get_ray(x, y, rng);
+				r.index = int(local);
+				rays.push_back(PackedRay::pack(r));
+				sample_values[local] = color(0., 0., 0.);
+			}
+
+			for (uint32_t bounce = 1; !rays.empty(); ++bounce) {
+				// Extend: closest hit for every live ray
+				hits.clear();
+				misses.clear();
+				for (uint32_t k = 0; k < rays.size(); ++k) {
+					real t;
+					const int64_t slot = closest_slot(scene, rays[k].unpack(), Interval(0, infinity), t, counters);
+					if (slot >= 0) {
+						hits.push_back(PackedHit{ t, uint32_t(slot), k });
+					}
+					else {
+						misses.push_back(k);
+					}
+				}
+
+				// Camera rays' first hits are the pixels' features
+				if (bounce == 1 && tile.has_auxiliary()) {
+					for (const PackedHit& h : hits) {
+						const Ray r = rays[h.ray].unpack();
+						tile.add_features(size_t(r.index), first_hit(scene, r, h.slot, h.t));
+					}
+					for (const uint32_t k : misses) {
+						const Ray r = rays[k].unpack();
+						tile.add_features(size_t(r.index), first_hit(scene, r, -1, 0));
+					}
+				}
+
+				// Accumulate: rays that escaped pick up the background
+				for (const uint32_t k : misses) {
+					const Ray r = rays[k].unpack();
+					sample_values[r.index] += background(r) * r.attenuation;
+					counters.record_path(int(bounce) - 1);
+				}
+
+				// Shade: bin by scatter function, then run each bin as one loop
+				for (auto& queue : shade_queues) {
+					queue.clear();
+				}
+				// Each ray's stream is keyed on its pixel, sample and bounce, so splitting the
+				// choice (dimensions 0 and 1) from the scatter itself draws the same numbers
+				// the depth-first path would
+				for (const PackedHit& h : hits) {
+					const Material& mat = scene.material(scene.material_index(h.slot));
+					const uint32_t local = uint32_t(rays[h.ray].index);
+					rng.seek(global_pixel(local), uint32_t(tile.stats[local].count), bounce);
+					shade_queues[size_t(choose_scatter(mat, rng))].push_back(h);
+				}
+
+				next_rays.clear();
+				for (size_t kind = 0; kind < 3; ++kind) {
+					counters.scatters[kind] += shade_queues[kind].size();
+					for (const PackedHit& h : shade_queues[kind]) {
+						const Ray r = rays[h.ray].unpack();
+						const HitRecord rec = hit_record(scene, r, h.t, h.slot);
+						const Material& mat = scene.material(rec.material);
+						rng.seek(global_pixel(uint32_t(r.index)), uint32_t(tile.stats[r.index].count), bounce, 2);
+						std::optional<Ray> scattered;
+						switch (ScatterKind(kind)) {
+						case ScatterKind::Lambertian:
+							scattered = scatter_lambertian(mat, r, rec, rng);
+							break;
+						case ScatterKind::Dielectric:
+							scattered = scatter_dielectric(mat, r, rec, rng);
+							break;
+						default:
+							scattered = scatter_metallic(mat, r, rec, rng);
 							break;
 						}
-						const std::optional<HitRecord> closest_hit = hit(ecs, r, Interval(0, infinity));
-						if (closest_hit.has_value()) {
-							const vec3 direction = closest_hit->normal + random_unit_vector(thread_rng);
-							const auto new_ray = scatter(ecs, r, closest_hit.value(), thread_rng);
-							if (new_ray.has_value()) {
-								r = new_ray.value();
-							}
-							else {
-								break;
+						// Compact: only rays that can still bounce move on to the next pass
+						if (scattered.has_value() && scattered->depth >= 0) {
+							if (survives_roulette(*scattered, int(bounce), rng, counters)) {
+								next_rays.push_back(PackedRay::pack(scattered.value()));
+								continue;
 							}
 						}
-						else {
-							auto a = 0.5 * (glm::normalize(r.direction).y + 1.0);
-							const color background_color = (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
-							pixel_colors[r.index] += background_color * r.attenuation;
-							break;
+						else if (scattered.has_value()) {
+							++counters.depth_terminated;
 						}
+						counters.record_path(int(bounce));
 					}
 				}
+				std::swap(rays, next_rays);
 			}
-			finished_blocklines++;
-			bar.set_progress(std::floor((float(finished_blocklines) / float(total_blocklines)) * 100.f));
+
+			// Fold the finished sample into each pixel and drop the ones that converged
+			still_active.clear();
+			for (const uint32_t local : active) {
+				tile.colors[local] += accum_color(sample_values[local]);
+				tile.stats[local].add(luminance(sample_values[local]));
+				if (!pixel_done(cam, tile.stats[local])) {
+					still_active.push_back(local);
+				}
+			}
+			std::swap(active, still_active);
 		}
+	}
 
+	Checkpoint RenderSystem::empty_checkpoint(const Camera& cam, uint64_t seed) const {
+		Checkpoint checkpoint(cam, seed, settings.sampler);
+		checkpoint.russian_roulette = settings.russian_roulette;
+		checkpoint.roulette_bounces = settings.roulette_bounces;
+		checkpoint.roulette_max_survival = settings.roulette_max_survival;
+		return checkpoint;
 	}
 
-	std::vector<float> RenderSystem::render_ecs(ECS& ecs, const Camera& cam, RNG& rng) const {
-		std::vector<color> pixel_colors(cam.width * cam.height, color(0., 0., 0.));
+	void RenderSystem::save_checkpoint(const Checkpoint& checkpoint) const {
+		try {
+			checkpoint.save(settings.checkpoint_path);
+		}
+		catch (const std::runtime_error& error) {
+			std::cerr << "Failed to write checkpoint: " << error.what() << std::endl;
+		}
+	}
+
+	ThreadPool& RenderSystem::thread_pool() {
+		// Resolved the way ThreadPool resolves 0, so going back to 0 regrows a smaller pool
+		const size_t wanted = settings.thread_count > 0
+			? size_t(settings.thread_count)
+			: size_t(std::max(1u, std::thread::hardware_concurrency()));
+		if (!m_pool || m_pool->size() != wanted) {
+			m_pool = std::make_unique<ThreadPool>(wanted);
+		}
+		return *m_pool;
+	}
+
+	void RenderSystem::write_stats(const RenderStats& stats) const {
+		if (!settings.stats_path.empty()) {
+			std::ofstream out(settings.stats_path);
+			stats.write_json(out);
+			if (!out) {
+				std::cerr << "Failed to write render stats to " << settings.stats_path << std::endl;
+			}
+		}
+		if (!settings.trace_path.empty()) {
+			std::ofstream out(settings.trace_path);
+			stats.write_trace(out);
+			if (!out) {
+				std::cerr << "Failed to write render trace to " << settings.trace_path << std::endl;
+			}
+		}
+	}
+
+	std::vector<float> RenderSystem::render_ecs(const ECS& ecs, const Camera& cam, RNG& rng, AuxiliaryBuffers* auxiliary) {
+		const auto compile_start = std::chrono::high_resolution_clock::now();
+		const SceneSnapshot scene = SceneSnapshot::compile(ecs);
+		const auto compile_end = std::chrono::high_resolution_clock::now();
+		const auto compile_us = std::chrono::duration_cast<std::chrono::microseconds>(compile_end - compile_start);
+		std::clog << "scene compile took " << compile_us.count() / 1000. << "ms, "
+			<< scene.bvh.node_count() << " bvh nodes for " << scene.spheres.size() << " spheres, "
+			<< scene.bvh.static_first() << " in moving leaves"
+			<< (scene.bvh.interpolated() ? ", interpolated" : "");
+		if (scene.triangles.size() > 0) {
+			std::clog << ", " << scene.mesh_bvh.node_count() << " bvh nodes for " << scene.triangles.size() << " triangles";
+		}
+		std::clog << std::endl;
+		return render(scene, cam, rng, auxiliary);
+	}
 
-		ProgressBar bar{
-			option::BarWidth{50},
-			option::Start{"["},
-			option::Fill{"="},
-			option::Lead{">"},
-			option::Remainder{" "},
-			option::End{"]"},
-			option::PostfixText{"Render"},
-			option::ForegroundColor{Color::green},
-			option::ShowPercentage{true},
-			option::FontStyles{std::vector<FontStyle>{FontStyle::bold}}
+	void RenderSystem::render_animation(ECS& ecs, const Camera& cam, RNG& rng, int frame_count,
+		const std::function<void(int, const std::vector<float>&)>& write_frame) {
+		using clock = std::chrono::steady_clock;
+		const auto ms_since = [](clock::time_point start) {
+			return std::chrono::duration<double, std::milli>(clock::now() - start).count();
 		};
-		std::vector<std::thread> threads;
+		// Every frame would overwrite the one streamed or checkpointed before it, and a
+		// streamed frame comes back empty
+		if (!settings.output_path.empty() || !settings.checkpoint_path.empty()) {
+			throw std::runtime_error("Animations write their own frames and cannot stream or checkpoint");
+		}
+
+		ThreadPool& pool = thread_pool();
+		auto bvh_start = clock::now();
+		SceneSnapshot scene = SceneSnapshot::compile(ecs);
+		double build_ms = ms_since(bvh_start);
+		double build_cost = scene.bvh.sah_cost();
+		double refit_ms_total = 0.;
+		int refits = 0;
+		std::clog << "frame 0: build " << build_ms << "ms, SAH cost " << build_cost << std::endl;
+
+		// At most one frame is being written while the next one renders
+		std::future<void> writing;
+		for (int frame = 0; frame < frame_count; ++frame) {
+			const auto frame_start = clock::now();
+			if (frame > 0) {
+				ecs.update(pool);
+				bvh_start = clock::now();
+				const bool refit = scene.refit(ecs) && scene.bvh.sah_cost() <= build_cost * settings.refit_limit;
+				const double refit_ms = ms_since(bvh_start);
+				if (refit) {
+					refit_ms_total += refit_ms;
+					++refits;
+					std::clog << "frame " << frame << ": refit " << refit_ms << "ms, SAH cost "
+						<< scene.bvh.sah_cost() / build_cost << "x the last build" << std::endl;
+				}
+				else {
+					bvh_start = clock::now();
+					scene = SceneSnapshot::compile(ecs);
+					build_ms = ms_since(bvh_start);
+					build_cost = scene.bvh.sah_cost();
+					std::clog << "frame " << frame << ": rebuild " << build_ms << "ms after a " << refit_ms
+						<< "ms refit, SAH cost " << build_cost << std::endl;
+				}
+			}
+
+			std::vector<float> image = render(scene, cam, rng);
+			const double render_ms = ms_since(frame_start);
+			if (writing.valid()) {
+				writing.get();
+			}
+			writing = std::async(std::launch::async, [&write_frame, frame, image = std::move(image)] {
+				write_frame(frame, image);
+				});
+			std::clog << "frame " << frame << " took " << render_ms << "ms" << std::endl;
+		}
+		if (writing.valid()) {
+			writing.get();
+		}
+		if (refits > 0) {
+			std::clog << "refit averaged " << refit_ms_total / refits << "ms against a " << build_ms
+				<< "ms build" << std::endl;
+		}
+		// The systems ran between frames only
+		if (frame_count > 1) {
+			std::clog << "system updates:" << std::endl;
+			ecs.reportSystemTimings(std::clog);
+		}
+	}
 
-		const int block_width = cam.width;
-		const int block_height = std::ceil(cam.height / 32);
+	std::vector<float> RenderSystem::render(const SceneSnapshot& scene, const Camera& camera, RNG& rng, AuxiliaryBuffers* auxiliary) {
+		// The features average every sample of a pixel, and the filter and the scores work
+		// on the whole frame
+		const bool streaming = !settings.output_path.empty();
+		const bool features = auxiliary != nullptr || settings.denoise;
+		const bool resuming = !settings.checkpoint_path.empty() && settings.resume;
+		if (features && (streaming || resuming)) {
+			throw std::runtime_error("Auxiliary buffers and denoising need the whole frame in memory and cannot stream or resume");
+		}
+		if (!settings.reference_path.empty() && streaming) {
+			throw std::runtime_error("Comparing against a reference needs the whole frame in memory and cannot stream");
+		}
 
-		const int total_blocklines = std::ceil(cam.width / float(block_width)) * cam.height;
-		const int total_blocks = std::ceil(cam.width / float(block_width)) * std::ceil(cam.height / float(block_height));
-		std::atomic<int> finished_blocklines = 0;
+		// Every tile shares the seed, samples pick their own stream with RNG::seek
+		uint64_t seed = rng.next_u64();
+		Camera cam = camera;
+		std::unique_ptr<Checkpoint> checkpoint;
+		if (!settings.checkpoint_path.empty()) {
+			if (settings.resume) {
+				checkpoint = std::make_unique<Checkpoint>(Checkpoint::load(settings.checkpoint_path));
+				// The checkpoint's view and seed win, only the sample budget may change
+				cam = checkpoint->camera;
+				cam.samples_per_pixel = camera.samples_per_pixel;
+				checkpoint->camera.samples_per_pixel = camera.samples_per_pixel;
+				seed = checkpoint->seed;
+				// Continuing one sampler's samples with another's would mix two sequences
+				// under the same sample indices
+				if (checkpoint->sampler != settings.sampler) {
+					throw std::runtime_error(settings.checkpoint_path + " was rendered with the "
+						+ sampler_name(checkpoint->sampler) + " sampler, not " + sampler_name(settings.sampler));
+				}
+				// Likewise, paths cut by one roulette and by another estimate with different
+				// weights and must not share a pixel mean
+				if (checkpoint->russian_roulette != settings.russian_roulette
+					|| (settings.russian_roulette && (checkpoint->roulette_bounces != settings.roulette_bounces
+						|| checkpoint->roulette_max_survival != settings.roulette_max_survival))) {
+					throw std::runtime_error(settings.checkpoint_path + " was rendered with other Russian roulette settings");
+				}
+				std::clog << "resuming " << settings.checkpoint_path << std::endl;
+			}
+			else {
+				checkpoint = std::make_unique<Checkpoint>(empty_checkpoint(cam, seed));
+			}
+		}
 
+		// Read before rendering, so a bad reference fails fast
+		std::vector<float> reference;
+		if (!settings.reference_path.empty()) {
+			int reference_width, reference_height;
+			reference = PfmImage::read(settings.reference_path, reference_width, reference_height);
+			if (reference_width != cam.width || reference_height != cam.height) {
+				throw std::runtime_error(settings.reference_path + " is " + std::to_string(reference_width) + "x"
+					+ std::to_string(reference_height) + ", the render " + std::to_string(cam.width) + "x" + std::to_string(cam.height));
+			}
+		}
+
+		// Finished tiles are resolved straight into the image, or into the mapped file when
+		// streaming, so there are no full-frame accumulators and no pass after the render
+		std::unique_ptr<PfmImage> output;
+		std::vector<float> image;
+		if (streaming) {
+			output = std::make_unique<PfmImage>(settings.output_path, cam.width, cam.height);
+		}
+		else {
+			image.resize(size_t(cam.width) * size_t(cam.height) * m_channels);
+		}
+		const auto row = [&](int x, int y) {
+			return streaming ? output->pixel(x, y) : &image[(size_t(y) * cam.width + x) * m_channels];
+		};
+		AuxiliaryBuffers own_auxiliary;
+		AuxiliaryBuffers& aux = auxiliary ? *auxiliary : own_auxiliary;
+		if (features) {
+			const size_t pixels = size_t(cam.width) * size_t(cam.height);
+			aux.albedo.assign(pixels * 3, 0.f);
+			aux.normal.assign(pixels * 3, 0.f);
+			aux.depth.assign(pixels, 0.f);
+		}
+
+		const int block_width = settings.tile_width > 0 ? settings.tile_width : cam.width;
+		const int block_height = settings.tile_height > 0 ? settings.tile_height : cam.height;
+
+		struct Tile {
+			int i0, i1, j0, j1;
+		};
+		std::vector<Tile> tiles;
 		for2dTiled(cam.width, cam.height, block_height, block_width,
 			[&](int i0, int i1, int j0, int j1) {
-				threads.push_back(std::thread(
-					&RenderSystem::render_tile,
-					this,
-					i0, i1, j0, j1,
-					std::ref(ecs),
-					std::cref(cam),
-					std::ref(pixel_colors),
-					std::ref(finished_blocklines),
-					std::ref(bar),
-					total_blocklines,
-					rng.clone()));
+				tiles.push_back(Tile{ i0, i1, j0, j1 });
 			});
-		for (auto& thread : threads) {
-			thread.join();
-		}
 
-		std::vector<float> image(cam.width * cam.height * m_channels);
-		for (int y = 0; y < cam.height; ++y) {
-			for (int x = 0; x < cam.width; ++x) {
+		ThreadPool& pool = thread_pool();
+		RenderStats stats(pool.size());
+		std::vector<TileBuffer> buffers(pool.size());
+
+		// The bar is drawn from its own thread, which samples the per-thread pixel counts
+		// instead of having every worker take the bar's lock
+		std::atomic<bool> rendering = true;
+		std::thread progress([&] {
+			ProgressBar bar{
+				option::BarWidth{50},
+				option::Start{"["},
+				option::Fill{"="},
+				option::Lead{">"},
+				option::Remainder{" "},
+				option::End{"]"},
+				option::PostfixText{"Render"},
+				option::ForegroundColor{Color::green},
+				option::ShowPercentage{true},
+				option::FontStyles{std::vector<FontStyle>{FontStyle::bold}}
+			};
+			const double total_pixels = double(cam.width) * double(cam.height);
+			while (rendering.load(std::memory_order_relaxed)) {
+				bar.set_progress(std::floor(float(stats.pixels_done() / total_pixels) * 100.f));
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+			bar.set_progress(100.f);
+			});
 
-				const color pixel_color = pixel_colors[y * cam.width + x] / double(cam.samples_per_pixel);
-				const Interval intensity(0., 1.);
-				const int idx = (y * cam.width + x) * m_channels;
-				//TODO: Avoid this copy, use span?
-				image[idx + 0] = intensity.clamp(pixel_color.x);   // R
-				image[idx + 1] = intensity.clamp(pixel_color.y);   // G
-				image[idx + 2] = intensity.clamp(pixel_color.z);   // B
+		// Workers copy each finished tile into the checkpoint under that tile's lock. The
+		// writer snapshots one tile at a time under the same locks and writes the snapshot
+		// without holding any, so a worker waits at most for one tile copy, never for disk.
+		std::vector<std::mutex> tile_locks(checkpoint ? tiles.size() : 0);
+		std::mutex checkpoint_mutex;
+		std::condition_variable checkpoint_wake;
+		std::thread checkpointer;
+		if (checkpoint) {
+			checkpointer = std::thread([&] {
+				Checkpoint snapshot = empty_checkpoint(cam, seed);
+				TileBuffer scratch;
+				const auto interval = std::chrono::duration<double>(settings.checkpoint_interval);
+				std::unique_lock<std::mutex> lock(checkpoint_mutex);
+				while (!checkpoint_wake.wait_for(lock, interval, [&] { return !rendering.load(); })) {
+					lock.unlock();
+					for (size_t index = 0; index < tiles.size(); ++index) {
+						const Tile& tile = tiles[index];
+						scratch.reset(tile.i0, tile.i1, tile.j0, tile.j1);
+						{
+							std::lock_guard<std::mutex> tile_lock(tile_locks[index]);
+							checkpoint->load_tile(scratch);
+						}
+						snapshot.store_tile(scratch);
+					}
+					save_checkpoint(snapshot);
+					lock.lock();
+				}
+				});
+		}
+
+		pool.parallel_for(tiles.size(), [&](size_t index) {
+			const Tile& tile = tiles[index];
+			ThreadCounters& counters = stats.threads[pool.thread_index()];
+			const double start_us = stats.since_start_us();
+			TileBuffer& buffer = buffers[pool.thread_index()];
+			buffer.reset(tile.i0, tile.i1, tile.j0, tile.j1, features);
+			if (checkpoint) {
+				// Only this worker writes the tile's region, so reading it needs no lock
+				checkpoint->load_tile(buffer);
+			}
+			render_tile(scene, cam, buffer, counters, RNG(seed));
+			if (checkpoint) {
+				std::lock_guard<std::mutex> lock(tile_locks[index]);
+				checkpoint->store_tile(buffer);
+			}
+			for (int y = tile.j0; y < tile.j1; ++y) {
+				buffer.resolve_row(y, row(tile.i0, y));
+				if (features) {
+					const size_t first = size_t(y) * size_t(cam.width) + size_t(tile.i0);
+					buffer.resolve_features_row(y, &aux.albedo[first * 3], &aux.normal[first * 3], &aux.depth[first]);
+				}
+			}
+			counters.tiles.push_back(TileEvent{ tile.i0, tile.i1, tile.j0, tile.j1, start_us, stats.since_start_us() - start_us });
+			});
+		stats.seconds = stats.since_start_us() * 1e-6;
+		{
+			std::lock_guard<std::mutex> lock(checkpoint_mutex);
+			rendering = false;
+		}
+		checkpoint_wake.notify_all();
+		progress.join();
+		if (checkpoint) {
+			checkpointer.join();
+			save_checkpoint(*checkpoint);
+		}
 
+		if (!reference.empty()) {
+			stats.error = compare_images(image, reference);
+		}
+		if (settings.denoise) {
+			const double denoise_start_us = stats.since_start_us();
+			image = denoise(image, aux, cam.width, cam.height, settings.denoise_settings, pool);
+			stats.denoise_seconds = (stats.since_start_us() - denoise_start_us) * 1e-6;
+			std::clog << "denoising took " << stats.denoise_seconds * 1000. << "ms" << std::endl;
+			if (!reference.empty()) {
+				stats.denoised_error = compare_images(image, reference);
 			}
 		}
+		const auto log_error = [&](const char* label, const std::optional<ImageError>& error) {
+			if (error) {
+				std::clog << label << " against " << settings.reference_path << ": RMSE " << error->rmse
+					<< ", relMSE " << error->rel_mse << ", PSNR " << error->psnr << "dB" << std::endl;
+			}
+		};
+		log_error("render", stats.error);
+		log_error("denoised render", stats.denoised_error);
+
+		write_stats(stats);
+
+		if (settings.adaptive) {
+			uint64_t total = 0;
+			int min_count = INT_MAX, max_count = 0;
+			for (const ThreadCounters& counters : stats.threads) {
+				total += counters.samples;
+				min_count = std::min(min_count, counters.min_pixel_samples);
+				max_count = std::max(max_count, counters.max_pixel_samples);
+			}
+			std::clog << "adaptive sampling averaged " << double(total) / (double(cam.width) * cam.height)
+				<< " spp (min " << min_count << ", max " << max_count << ")" << std::endl;
+		}
+
+		if (streaming) {
+			output->flush();
+		}
 		return image;
 	}
 
-}
\ No newline at end of file
+}
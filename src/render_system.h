@@ -1,39 +1,188 @@
 #ifndef RENDER_SYSTEM_H
 #define RENDER_SYSTEM_H
 
+#include <functional>
 #include <optional>
+#include <string>
 #include <indicators/progress_bar.hpp>
 #include "camera.h"
+#include "checkpoint.h"
+#include "denoise.h"
 #include "ecs/ECS.h"
+#include "geometry/bvh.h"
 #include "geometry/hittable.h"
 #include "geometry/hit_record.h"
+#include "geometry/packed_ray.h"
+#include "geometry/ray_packet.h"
+#include "geometry/sphere_soa.h"
 #include "geometry/interval.h"
+#include "render_stats.h"
+#include "sampler.h"
+#include "scene_snapshot.h"
+#include "thread_pool.h"
+#include "tile_buffer.h"
 
 using namespace indicators;
 
 namespace render {
+
+    enum class RenderMode {
+        DepthFirst, // Each sample is followed through all its bounces before the next one starts
+        Wavefront // All samples of a tile advance one bounce at a time through batched stages
+    };
+
+    // Order in which the depth-first path visits the pixels, or packets, of a tile
+    enum class PixelOrder {
+        Scanline, // Row by row
+        Morton // Along the Z-order curve, so consecutive work stays close in both directions
+    };
+
+    enum class ScatterKind : uint8_t {
+        Lambertian,
+        Metallic,
+        Dielectric
+    };
+
+    struct RenderSettings {
+        RenderMode mode = RenderMode::DepthFirst;
+        int thread_count = 0; // Render threads, 0 uses every hardware thread
+        int tile_width = 32; // Tile size in pixels, 0 spans the whole image
+        int tile_height = 32;
+        // The depth-first path traces camera rays packet_size x packet_size pixels at a
+        // time (up to 8): the packet walks the BVH as one bundle to its rays' first hits,
+        // then each ray bounces on alone. 0 traces every camera ray alone.
+        int packet_size = 8;
+        PixelOrder pixel_order = PixelOrder::Morton;
+        // Where the paths' numbers come from, see sampler.h. Checkpoints record it, and
+        // resuming with a different one throws std::runtime_error.
+        SamplerKind sampler = SamplerKind::Sobol;
+
+        // Russian roulette: past roulette_bounces bounces, a path goes on with probability
+        // equal to its largest throughput component (at most roulette_max_survival) and is
+        // weighted up by its inverse when it does, so dim paths stop early without biasing
+        // the image. Camera::max_depth still caps every path. Checkpoints record these,
+        // and resuming with others throws std::runtime_error.
+        bool russian_roulette = true;
+        int roulette_bounces = 5;
+        double roulette_max_survival = 0.95;
+
+        // Adaptive sampling replaces Camera::samples_per_pixel with a per-pixel budget
+        bool adaptive = false;
+        int min_samples_per_pixel = 16;
+        int max_samples_per_pixel = 256;
+        double noise_threshold = 0.02; // Relative standard error of the pixel mean to stop at
+
+        // Counter totals as JSON and a Chrome trace of the tiles, skipped when empty
+        std::string stats_path;
+        std::string trace_path;
+
+        // Streaming output: when set, each finished tile is resolved straight into this
+        // memory-mapped PFM file and render() returns an empty image. Only the tiles in
+        // flight hold accumulators, so memory no longer grows with the resolution.
+        std::string output_path;
+
+        // Checkpointing: when checkpoint_path is set, the raw sample state is written there
+        // every checkpoint_interval seconds, from a background thread, and once more at the
+        // end. With resume, the render instead continues the checkpoint at that path with
+        // its camera and seed, topping every pixel up to the current sample budget, so a
+        // finished 64 spp render can be extended to 256 spp. The sample state of the whole
+        // frame is kept in memory while checkpointing.
+        std::string checkpoint_path;
+        double checkpoint_interval = 300.;
+        bool resume = false;
+
+        // Denoising: render() filters the frame with denoise() before returning it, guided
+        // by auxiliary buffers of the first-hit albedo, normal and depth of its samples.
+        // Like the buffers themselves (see render()), it needs the whole frame in memory
+        // and all of its samples in this render: no output_path, no resume.
+        bool denoise = false;
+        DenoiseSettings denoise_settings;
+        // High-spp render of the same view, as a PFM, to score the frame against before and
+        // after denoising. The scores go to the log and the stats JSON, to weigh sample
+        // counts against denoising per job. Needs the frame in memory.
+        std::string reference_path;
+
+        // Animation refits the BVH between frames, and rebuilds it instead once refits have
+        // pushed its SAH cost past this multiple of the cost right after the last build
+        double refit_limit = 1.5;
+    };
+
     class RenderSystem :public System {
     public:
+        RenderSettings settings;
+
         std::optional<HitRecord> hit_sphere(const Sphere& sphere, const Ray& r, Interval ray_t) const;
-        std::optional<HitRecord> hit(ECS& ecs, const Ray& r, Interval ray_t) const;
+        int64_t closest_slot(const SceneSnapshot& scene, const Ray& r, Interval ray_t, real& t, ThreadCounters& counters) const;
+        HitRecord hit_record(const SceneSnapshot& scene, const Ray& r, real t, int64_t slot) const;
+        std::optional<HitRecord> hit(const SceneSnapshot& scene, const Ray& r, Interval ray_t, ThreadCounters& counters) const;
+        // closest_slot for every ray of the packet over (0, infinity), into packet.slot and
+        // packet.t. Packets whose rays diverge, or too few to fill a vector, go ray by ray.
+        void closest_slots(const SceneSnapshot& scene, RayPacket& packet, ThreadCounters& counters) const;
         std::optional<Ray> scatter_lambertian(const Material& mat, const Ray& r, const HitRecord& rec, RNG& rng) const;
         std::optional<Ray> scatter_metallic(const Material& mat, const Ray& r, const HitRecord& rec, RNG& rng) const;
         std::optional<Ray> scatter_dielectric(const Material& mat, const Ray& r, const HitRecord& rec, RNG& rng) const;
-        std::optional<Ray> scatter(ECS& ecs, const Ray& r, const HitRecord& rec, RNG& rng) const;
-        void render_pixel(ECS& ecs, const Camera& cam, int x, int y, std::vector<color>& pixel_colors, RNG& rng) const;
+        ScatterKind choose_scatter(const Material& mat, RNG& rng) const;
+        // Russian roulette for r, just scattered on bounce bounces with rng on that bounce's
+        // stream. Scales r's attenuation when it survives, counts it when it does not.
+        bool survives_roulette(Ray& r, int bounces, RNG& rng, ThreadCounters& counters) const;
+        std::optional<Ray> scatter(const SceneSnapshot& scene, const Ray& r, const HitRecord& rec, RNG& rng, ThreadCounters& counters) const;
+        color background(const Ray& r) const;
+        // Features of the closest hit of r, slot at distance t (slot -1 on a miss)
+        FirstHit first_hit(const SceneSnapshot& scene, const Ray& r, int64_t slot, real t) const;
+        // With first, also stores what the path hits first there
+        color trace(const SceneSnapshot& scene, Ray r, RNG& rng, ThreadCounters& counters, FirstHit* first = nullptr) const;
+        // Continues the path of r from its closest hit, slot at distance t (slot -1 on a miss)
+        color trace_from(const SceneSnapshot& scene, Ray r, int64_t slot, real t, RNG& rng, ThreadCounters& counters,
+            FirstHit* first = nullptr) const;
+        color sample_pixel(const SceneSnapshot& scene, const Camera& cam, int x, int y, int sample, RNG& rng, ThreadCounters& counters,
+            FirstHit* first = nullptr) const;
+        // Samples the pixel from its current count until it meets the sample budget
+        void render_pixel(const SceneSnapshot& scene, const Camera& cam, int x, int y, TileBuffer& tile, RNG& rng, ThreadCounters& counters) const;
+        // Samples the pixels of [x0, x1) x [y0, y1) until each meets its budget, one packet of
+        // camera rays per round
+        void render_block(const SceneSnapshot& scene, const Camera& cam, int x0, int y0, int x1, int y1,
+            TileBuffer& tile, RNG& rng, ThreadCounters& counters) const;
+        // Continues every pixel of the tile, which may already hold samples, drawing the
+        // paths' numbers from settings.sampler
         void render_tile(
-            int i0, int i1, int j0, int j1,
-            ECS& ecs, const Camera& cam,
-            std::vector<color>& pixel_colors,
-            std::atomic<int>& finished_blocks,
-            ProgressBar& bar,
-            int total_blocks,
+            const SceneSnapshot& scene, const Camera& cam,
+            TileBuffer& tile,
+            ThreadCounters& counters,
             RNG rng
         ) const;
-        std::vector<float> render_ecs(ECS& ecs, const Camera& cam, RNG& rng) const;
+        void render_tile_wavefront(
+            const SceneSnapshot& scene, const Camera& cam,
+            TileBuffer& tile,
+            ThreadCounters& counters,
+            RNG& rng
+        ) const;
+        // Compiles the ECS's Sphere + Material group and its meshes into a snapshot and renders it
+        std::vector<float> render_ecs(const ECS& ecs, const Camera& cam, RNG& rng, AuxiliaryBuffers* auxiliary = nullptr);
+        // Renders through camera, or through the checkpoint's camera when resuming. With
+        // auxiliary, also fills it with the frame's first-hit features, which like denoising
+        // needs the frame in memory and excludes resume. Throws std::runtime_error then.
+        std::vector<float> render(const SceneSnapshot& scene, const Camera& camera, RNG& rng, AuxiliaryBuffers* auxiliary = nullptr);
+        // Renders frame_count frames, running the ECS's systems (e.g. MotionSystem) between
+        // frames. write_frame(frame, image) runs on its own thread while the next frame
+        // renders. Streaming output and checkpoints would be overwritten by every frame, so
+        // setting output_path or checkpoint_path throws std::runtime_error.
+        void render_animation(ECS& ecs, const Camera& cam, RNG& rng, int frame_count,
+            const std::function<void(int, const std::vector<float>&)>& write_frame);
+
+        // Pool kept alive across renders, recreated when settings.thread_count changes.
+        // Also lends its threads to work around renders, such as loading scenes.
+        ThreadPool& thread_pool();
 
     private:
+        bool pixel_done(const Camera& cam, const PixelStats& stats) const;
+        // Empty checkpoint of a render through cam with seed under the current settings
+        Checkpoint empty_checkpoint(const Camera& cam, uint64_t seed) const;
+        // Reports failures instead of throwing, a lost checkpoint must not end the render
+        void save_checkpoint(const Checkpoint& checkpoint) const;
+        void write_stats(const RenderStats& stats) const;
+
         int m_channels = 3; // Number of color channels (R, G, B)
+        std::unique_ptr<ThreadPool> m_pool;
     };
 
 }
@@ -0,0 +1,225 @@
+#include "sampler.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "common.h"
+
+namespace render {
+
+	namespace {
+		// Side of the tiled blue-noise mask, a power of two
+		constexpr uint32_t MASK_SIZE = 64;
+		constexpr uint32_t MASK_BITS = 12; // log2(MASK_SIZE * MASK_SIZE)
+
+		// Salts keeping the sampler's hashes apart from the RNG streams and each other
+		constexpr uint64_t PAIR_SALT = 0x5a4d7b1e6f3c2981ULL;
+		constexpr uint64_t AXIS_SALT = 0x2b7e151628aed2a6ULL;
+		constexpr uint64_t SHIFT_SALT = 0xc13fa9a902a6328fULL;
+		constexpr uint64_t GOLDEN = 0x9e3779b97f4a7c15ULL; // Odd, so pixels keep distinct keys
+
+		uint32_t reverse_bits(uint32_t x) {
+			x = (x << 16) | (x >> 16);
+			x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+			x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+			x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+			x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+			return x;
+		}
+
+		// Hash permutation of Laine and Karras: each bit only depends on the bits below it
+		uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+			x += seed;
+			x ^= x * 0x6c50b47cu;
+			x ^= x * 0xb82f1e52u;
+			x ^= x * 0xc7afe638u;
+			x ^= x * 0x8d22f6e6u;
+			return x;
+		}
+
+		// Owen scrambling: flips each bit depending on the bits above it, which moves whole
+		// elementary intervals around and keeps the sequence's stratification
+		uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+			return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+		}
+
+		// Second Sobol dimension, of the primitive polynomial x + 1, bit-reversed: the XOR of
+		// one entry per 4 bits of the index, entry [i][n] the XOR of the reversed direction
+		// numbers of the bits set in n, shifted to bits 4i to 4i + 3
+		struct SobolTable {
+			uint32_t entries[8][16];
+		};
+
+		constexpr uint32_t reverse_bits_constexpr(uint32_t x) {
+			uint32_t reversed = 0;
+			for (int bit = 0; bit < 32; ++bit) {
+				reversed |= ((x >> bit) & 1u) << (31 - bit);
+			}
+			return reversed;
+		}
+
+		constexpr SobolTable make_sobol_table() {
+			uint32_t directions[32] = {};
+			uint32_t v = 1u << 31;
+			for (int bit = 0; bit < 32; ++bit, v ^= v >> 1) {
+				directions[bit] = reverse_bits_constexpr(v);
+			}
+			SobolTable table{};
+			for (int i = 0; i < 8; ++i) {
+				for (uint32_t n = 0; n < 16; ++n) {
+					for (int bit = 0; bit < 4; ++bit) {
+						if (n & (1u << bit)) {
+							table.entries[i][n] ^= directions[4 * i + bit];
+						}
+					}
+				}
+			}
+			return table;
+		}
+
+		constexpr SobolTable SOBOL_TABLE = make_sobol_table();
+
+		uint32_t reversed_sobol_1(uint32_t index) {
+			uint32_t reversed = 0;
+			for (int i = 0; i < 8; ++i) {
+				reversed ^= SOBOL_TABLE.entries[i][(index >> (4 * i)) & 15];
+			}
+			return reversed;
+		}
+
+		// Void-and-cluster (Ulichney 1993): a rank for every pixel of a MASK_SIZE x MASK_SIZE
+		// torus such that the pixels below any rank are spread as evenly as they can be.
+		// Pixels are scored by the Gaussian-weighted count of chosen pixels around them;
+		// the tightest cluster is the chosen pixel with the highest score, the largest void
+		// the free pixel with the lowest.
+		std::vector<uint16_t> make_blue_noise_mask() {
+			constexpr uint32_t n = MASK_SIZE * MASK_SIZE;
+			constexpr uint32_t wrap = MASK_SIZE - 1;
+			constexpr float sigma = 1.5f;
+			std::vector<float> kernel(n);
+			for (uint32_t dy = 0; dy < MASK_SIZE; ++dy) {
+				for (uint32_t dx = 0; dx < MASK_SIZE; ++dx) {
+					const float x = float(std::min(dx, MASK_SIZE - dx));
+					const float y = float(std::min(dy, MASK_SIZE - dy));
+					kernel[dy * MASK_SIZE + dx] = std::exp(-(x * x + y * y) / (2.f * sigma * sigma));
+				}
+			}
+			std::vector<float> energy(n, 0.f);
+			std::vector<uint8_t> chosen(n, 0);
+			const auto toggle = [&](uint32_t p, bool on) {
+				chosen[p] = on;
+				const float sign = on ? 1.f : -1.f;
+				for (uint32_t q = 0; q < n; ++q) {
+					const uint32_t dx = ((q & wrap) - (p & wrap)) & wrap;
+					const uint32_t dy = ((q / MASK_SIZE) - (p / MASK_SIZE)) & wrap;
+					energy[q] += sign * kernel[dy * MASK_SIZE + dx];
+				}
+			};
+			const auto tightest_cluster = [&] {
+				uint32_t best = n;
+				for (uint32_t p = 0; p < n; ++p) {
+					if (chosen[p] && (best == n || energy[p] > energy[best])) {
+						best = p;
+					}
+				}
+				return best;
+			};
+			const auto largest_void = [&] {
+				uint32_t best = n;
+				for (uint32_t p = 0; p < n; ++p) {
+					if (!chosen[p] && (best == n || energy[p] < energy[best])) {
+						best = p;
+					}
+				}
+				return best;
+			};
+
+			// A tenth of the pixels at hashed positions, then moved from the tightest cluster
+			// to the largest void until the void found is the pixel just freed
+			const uint32_t initial = n / 10;
+			uint64_t counter = 0;
+			for (uint32_t count = 0; count < initial; ) {
+				const uint32_t p = uint32_t(mix64(++counter) % n);
+				if (!chosen[p]) {
+					toggle(p, true);
+					++count;
+				}
+			}
+			while (true) {
+				const uint32_t cluster = tightest_cluster();
+				toggle(cluster, false);
+				const uint32_t emptiest = largest_void();
+				toggle(emptiest, true);
+				if (emptiest == cluster) {
+					break;
+				}
+			}
+
+			// The initial pixels rank below it, the densest ones last; the rest fill voids
+			std::vector<uint16_t> rank(n);
+			const std::vector<float> initial_energy = energy;
+			const std::vector<uint8_t> initial_chosen = chosen;
+			for (uint32_t r = initial; r-- > 0; ) {
+				const uint32_t cluster = tightest_cluster();
+				toggle(cluster, false);
+				rank[cluster] = uint16_t(r);
+			}
+			energy = initial_energy;
+			chosen = initial_chosen;
+			for (uint32_t r = initial; r < n; ++r) {
+				const uint32_t emptiest = largest_void();
+				toggle(emptiest, true);
+				rank[emptiest] = uint16_t(r);
+			}
+			return rank;
+		}
+
+		// Built on first use, the same for every render
+		const std::vector<uint16_t>& blue_noise_mask() {
+			static const std::vector<uint16_t> mask = make_blue_noise_mask();
+			return mask;
+		}
+	}
+
+	const char* sampler_name(SamplerKind kind) {
+		switch (kind) {
+		case SamplerKind::Sobol:
+			return "sobol";
+		case SamplerKind::BlueNoise:
+			return "bluenoise";
+		default:
+			return "random";
+		}
+	}
+
+	void sample_pair(SamplerKind kind, uint64_t seed, uint32_t x, uint32_t y, uint32_t sample,
+		uint32_t bounce, uint32_t pair, uint32_t& first, uint32_t& second) {
+		// Each pair of dimensions gets its own scramble, and its own order of the points so
+		// that pairs are not correlated with each other
+		const bool per_pixel = kind == SamplerKind::Sobol;
+		const uint64_t pixel = per_pixel ? (uint64_t(y) << 32 | x) * GOLDEN : 0;
+		const uint64_t key = mix64(seed ^ PAIR_SALT ^ pixel) + (uint64_t(bounce) << 32 | pair);
+		const uint64_t scramble = mix64(key);
+		const uint64_t axis_scramble = mix64(key ^ AXIS_SALT);
+		// Owen-scrambled index, then each Sobol dimension of it Owen-scrambled. Dimension 0
+		// is the index reversed, and a scramble starts by reversing, so the two cancel.
+		const uint32_t index = nested_uniform_scramble(sample, uint32_t(scramble));
+		first = reverse_bits(laine_karras_permutation(index, uint32_t(axis_scramble)));
+		second = reverse_bits(laine_karras_permutation(reversed_sobol_1(index), uint32_t(axis_scramble >> 32)));
+		if (per_pixel) {
+			return;
+		}
+
+		// Shift each dimension by the mask at an offset of its own. Over seeds a shift is
+		// uniform: each rank appears once in the mask and the low bits are hashed.
+		const uint64_t offsets = scramble >> 32;
+		const uint32_t low_bits = uint32_t(mix64(scramble ^ SHIFT_SALT));
+		const auto shift = [&](uint32_t offset_x, uint32_t offset_y, uint32_t low) {
+			const uint32_t mask_x = (x + offset_x) & (MASK_SIZE - 1);
+			const uint32_t mask_y = (y + offset_y) & (MASK_SIZE - 1);
+			return (uint32_t(blue_noise_mask()[mask_y * MASK_SIZE + mask_x]) << (32 - MASK_BITS)) | (low >> MASK_BITS);
+		};
+		first += shift(uint32_t(offsets), uint32_t(offsets >> 8), low_bits);
+		second += shift(uint32_t(offsets >> 16), uint32_t(offsets >> 24), low_bits * 0x9e3779b9u);
+	}
+
+}
@@ -0,0 +1,46 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+
+namespace render {
+
+    // Where the numbers of a sample's path come from. Every sampler is reached through
+    // RNG::random_real on the stream RNG::seek picks, so the render paths draw the same
+    // dimensions whichever is in use:
+    //  - bounce 0, the camera ray: pixel jitter (0, 1), lens (2, 3), time (4)
+    //  - bounce k: scatter choice (0, 1), then the scatter's own numbers (2, 3)
+    // The low-discrepancy samplers fill most of them two at a time from independently
+    // shuffled and scrambled copies of a 2D Sobol sequence (Burley, "Practical Hash-based
+    // Owen Scrambling", JCGT 2020), so the first 2^m samples of a pixel stratify each
+    // pair of dimensions into 2^m cells of every shape.
+    enum class SamplerKind : uint8_t {
+        Random, // Independent hashed numbers for every dimension
+        Sobol, // Owen-scrambled Sobol points, scrambled apart for every pixel
+        // One Owen-scrambled Sobol sequence for the whole frame, shifted modulo 1 per pixel
+        // by a blue-noise mask (Georgiev and Fajardo, "Blue-noise Dithered Sampling",
+        // SIGGRAPH 2016 talk): about the same error as Sobol, but spread as high-frequency
+        // noise that is less visible at low spp than Sobol's white noise
+        BlueNoise
+    };
+
+    // The sampler's command-line name: random, sobol or bluenoise
+    const char* sampler_name(SamplerKind kind);
+
+    // Whether a low-discrepancy sampler covers the dimension: the camera's five, then the
+    // scatter's own pair on every bounce. The other draws, the choice of scatter function
+    // and the Russian roulette decision, take the Random sampler's numbers; stratifying the
+    // choice cost a pair per bounce and did not lower the error.
+    constexpr bool sampled_dimension(uint32_t bounce, uint32_t dimension) {
+        return bounce == 0 ? dimension < 5 : dimension == 2 || dimension == 3;
+    }
+
+    // Dimensions 2 * pair and 2 * pair + 1 (see sampled_dimension) of the given sample of
+    // the pixel at (x, y), on bounce bounce of a render seeded with seed, as 32-bit fractions
+    // of 1. Owen scrambling keeps every point uniform on its own, so any sampler's image has
+    // the same expectation as the Random sampler's.
+    void sample_pair(SamplerKind kind, uint64_t seed, uint32_t x, uint32_t y, uint32_t sample,
+        uint32_t bounce, uint32_t pair, uint32_t& first, uint32_t& second);
+
+}
+#endif // SAMPLER_H
@@ -0,0 +1,233 @@
+#include "scene_file.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace render {
+
+	namespace {
+		constexpr char MAGIC[8] = { 'C', 'P', 'R', 'T', 'S', 'C', 'N', '\0' };
+		// Bumped whenever the layout changes, older files are rejected rather than misread
+		constexpr uint32_t VERSION = 1;
+		// Reads back as another value on a host of the other byte order
+		constexpr uint32_t BYTE_ORDER_MARK = 0x01020304u;
+
+		enum Field : uint32_t {
+			CenterX, CenterY, CenterZ, Radius,
+			DirectionX, DirectionY, DirectionZ,
+			AlbedoR, AlbedoG, AlbedoB,
+			Metallic, Dielectric, Fuzz, RefractionIndex,
+			FIELD_COUNT
+		};
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t byte_order;
+			uint32_t scalar_size; // Bytes per stored real, 4 or 8
+			uint32_t field_count;
+			uint64_t sphere_count;
+			char reserved[32];
+		};
+		static_assert(sizeof(Header) == 64, "Scene blocks start 64 bytes into the file");
+
+		// Spheres decoded per task, large enough to amortize scheduling
+		constexpr size_t READ_BATCH = size_t(1) << 16;
+		// Spheres per buffer when loading into an ECS, small enough to stay in cache
+		constexpr size_t LOAD_BATCH = size_t(1) << 14;
+	}
+
+	SceneFile::SceneFile(const std::string& path) : m_file(path) {
+		if (m_file.size() < sizeof(Header)) {
+			throw std::runtime_error(path + " is not a scene file");
+		}
+		Header header;
+		std::memcpy(&header, m_file.data(), sizeof(Header));
+		if (!std::equal(MAGIC, MAGIC + sizeof(MAGIC), header.magic)) {
+			throw std::runtime_error(path + " is not a scene file");
+		}
+		if (header.byte_order != BYTE_ORDER_MARK) {
+			throw std::runtime_error(path + " was written on a host of the other byte order");
+		}
+		if (header.version != VERSION || header.field_count != FIELD_COUNT) {
+			throw std::runtime_error(path + " has scene format version " + std::to_string(header.version)
+				+ ", expected " + std::to_string(VERSION));
+		}
+		if (header.scalar_size != sizeof(float) && header.scalar_size != sizeof(double)) {
+			throw std::runtime_error(path + " has a corrupt header");
+		}
+		const size_t sphere_bytes = size_t(FIELD_COUNT) * header.scalar_size;
+		if (header.sphere_count != (m_file.size() - sizeof(Header)) / sphere_bytes
+			|| (m_file.size() - sizeof(Header)) % sphere_bytes != 0) {
+			throw std::runtime_error(path + " is truncated or has a corrupt header");
+		}
+		m_count = size_t(header.sphere_count);
+		m_scalar_size = header.scalar_size;
+	}
+
+	template <typename Scalar>
+	void SceneFile::decode(size_t first, size_t count, Sphere* spheres, Material* materials) const {
+		const char* blocks = m_file.data() + sizeof(Header);
+		const auto field = [&](Field f) {
+			return reinterpret_cast<const Scalar*>(blocks + size_t(f) * m_count * sizeof(Scalar)) + first;
+		};
+		const Scalar* cx = field(CenterX);
+		const Scalar* cy = field(CenterY);
+		const Scalar* cz = field(CenterZ);
+		const Scalar* radius = field(Radius);
+		const Scalar* dx = field(DirectionX);
+		const Scalar* dy = field(DirectionY);
+		const Scalar* dz = field(DirectionZ);
+		const Scalar* r = field(AlbedoR);
+		const Scalar* g = field(AlbedoG);
+		const Scalar* b = field(AlbedoB);
+		const Scalar* metallic = field(Metallic);
+		const Scalar* dielectric = field(Dielectric);
+		const Scalar* fuzz = field(Fuzz);
+		const Scalar* refraction_index = field(RefractionIndex);
+		for (size_t i = 0; i < count; ++i) {
+			spheres[i] = Sphere{ point3(cx[i], cy[i], cz[i]), real(radius[i]), vec3(dx[i], dy[i], dz[i]) };
+			materials[i] = Material{ color(r[i], g[i], b[i]), real(metallic[i]), real(dielectric[i]),
+				real(fuzz[i]), real(refraction_index[i]) };
+		}
+	}
+
+	void SceneFile::read(size_t first, size_t count, Sphere* spheres, Material* materials) const {
+		assert(first + count <= m_count && "Reading past the last sphere.");
+		if (m_scalar_size == sizeof(float)) {
+			decode<float>(first, count, spheres, materials);
+		}
+		else {
+			decode<double>(first, count, spheres, materials);
+		}
+	}
+
+	void SceneFile::read(ThreadPool& pool, std::vector<Sphere>& spheres, std::vector<Material>& materials) const {
+		spheres.resize(m_count);
+		materials.resize(m_count);
+		pool.parallel_for((m_count + READ_BATCH - 1) / READ_BATCH, [&](size_t batch) {
+			const size_t first = batch * READ_BATCH;
+			const size_t count = std::min(READ_BATCH, m_count - first);
+			read(first, count, spheres.data() + first, materials.data() + first);
+			});
+	}
+
+	Entity SceneFile::load(ECS& ecs, ThreadPool& pool) const {
+		if (m_count >= MAX_ENTITIES) {
+			throw std::runtime_error("Scene has more spheres than the ECS has entities");
+		}
+		const Entity first = ecs.createEntities(Entity(m_count));
+
+		// Each thread decodes a batch into its own buffer, then the ECS takes the batches
+		// in order. No copy of the whole scene is held outside the ECS.
+		const size_t lanes = pool.size();
+		std::vector<std::vector<Sphere>> spheres(lanes, std::vector<Sphere>(LOAD_BATCH));
+		std::vector<std::vector<Material>> materials(lanes, std::vector<Material>(LOAD_BATCH));
+		for (size_t start = 0; start < m_count; start += lanes * LOAD_BATCH) {
+			const size_t batches = std::min(lanes, (m_count - start + LOAD_BATCH - 1) / LOAD_BATCH);
+			const auto batch_size = [&](size_t lane) {
+				return std::min(LOAD_BATCH, m_count - start - lane * LOAD_BATCH);
+			};
+			pool.parallel_for(batches, [&](size_t lane) {
+				read(start + lane * LOAD_BATCH, batch_size(lane), spheres[lane].data(), materials[lane].data());
+				});
+			for (size_t lane = 0; lane < batches; ++lane) {
+				const Entity batch_first = first + Entity(start + lane * LOAD_BATCH);
+				ecs.addComponents(batch_first, Entity(batch_size(lane)), spheres[lane].data());
+				ecs.addComponents(batch_first, Entity(batch_size(lane)), materials[lane].data());
+			}
+		}
+		return first;
+	}
+
+	void SceneFile::write(const std::string& path, const std::vector<Sphere>& spheres, const std::vector<Material>& materials) {
+		if (spheres.size() != materials.size()) {
+			throw std::runtime_error("Every sphere of a scene file needs a material");
+		}
+		const size_t count = spheres.size();
+		MappedFile file(path, sizeof(Header) + size_t(FIELD_COUNT) * count * sizeof(real));
+
+		Header header{};
+		std::copy(MAGIC, MAGIC + sizeof(MAGIC), header.magic);
+		header.version = VERSION;
+		header.byte_order = BYTE_ORDER_MARK;
+		header.scalar_size = sizeof(real);
+		header.field_count = FIELD_COUNT;
+		header.sphere_count = count;
+		std::memcpy(file.data(), &header, sizeof(Header));
+
+		real* blocks = reinterpret_cast<real*>(file.data() + sizeof(Header));
+		const auto field = [&](Field f) {
+			return blocks + size_t(f) * count;
+		};
+		for (size_t i = 0; i < count; ++i) {
+			const Sphere& sphere = spheres[i];
+			const Material& material = materials[i];
+			field(CenterX)[i] = sphere.center.x;
+			field(CenterY)[i] = sphere.center.y;
+			field(CenterZ)[i] = sphere.center.z;
+			field(Radius)[i] = sphere.radius;
+			field(DirectionX)[i] = sphere.direction.x;
+			field(DirectionY)[i] = sphere.direction.y;
+			field(DirectionZ)[i] = sphere.direction.z;
+			field(AlbedoR)[i] = material.albedo.x;
+			field(AlbedoG)[i] = material.albedo.y;
+			field(AlbedoB)[i] = material.albedo.z;
+			field(Metallic)[i] = material.metallic;
+			field(Dielectric)[i] = material.dielectric;
+			field(Fuzz)[i] = material.fuzz;
+			field(RefractionIndex)[i] = material.refraction_index;
+		}
+	}
+
+	void SceneFile::convert(const std::string& text_path, const std::string& path) {
+		std::ifstream in(text_path);
+		if (!in) {
+			throw std::runtime_error("Cannot open " + text_path);
+		}
+		std::vector<Sphere> spheres;
+		std::vector<Material> materials;
+		std::string line;
+		for (size_t line_number = 1; std::getline(in, line); ++line_number) {
+			const size_t start = line.find_first_not_of(" \t\r");
+			if (start == std::string::npos || line[start] == '#') {
+				continue;
+			}
+			const auto fail = [&](const std::string& message) {
+				return std::runtime_error(text_path + ":" + std::to_string(line_number) + ": " + message);
+			};
+			if (line.compare(start, 7, "sphere ") != 0 && line.compare(start, 7, "sphere\t") != 0) {
+				throw fail("expected a sphere");
+			}
+
+			// strtod skips the whitespace in front of each number
+			double values[15];
+			int value_count = 0;
+			const char* cursor = line.c_str() + start + 6;
+			while (value_count < 15) {
+				char* end;
+				const double value = std::strtod(cursor, &end);
+				if (end == cursor) {
+					break;
+				}
+				values[value_count++] = value;
+				cursor = end;
+			}
+			if (std::string(cursor).find_first_not_of(" \t\r") != std::string::npos) {
+				throw fail("unexpected '" + std::string(cursor) + "'");
+			}
+			if (value_count != 11 && value_count != 14) {
+				throw fail("expected 11 numbers, or 14 with a motion, got " + std::to_string(value_count));
+			}
+			const vec3 direction = value_count == 14 ? vec3(values[11], values[12], values[13]) : vec3(0., 0., 0.);
+			spheres.push_back(Sphere{ point3(values[0], values[1], values[2]), real(values[3]), direction });
+			materials.push_back(Material{ color(values[4], values[5], values[6]), real(values[7]), real(values[8]),
+				real(values[9]), real(values[10]) });
+		}
+		write(path, spheres, materials);
+	}
+
+}
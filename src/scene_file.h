@@ -0,0 +1,59 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ecs/ECS.h"
+#include "geometry/hittable.h"
+#include "io/mapped_file.h"
+#include "material/material.h"
+#include "thread_pool.h"
+
+namespace render {
+
+    // Binary scene: a 64-byte header followed by one block per sphere and material field
+    // (center x, center y, ..., refraction index), each holding that field for every
+    // sphere in order. Sphere i uses material i. Reals are stored at the precision of the
+    // build that wrote the file and converted on load.
+    //
+    // The file is memory-mapped, so opening it reads nothing but the header and the
+    // blocks are paged in by the threads decoding them.
+    class SceneFile {
+    public:
+        // Throws std::runtime_error when the file is missing, truncated or not a scene
+        // file of this version and byte order
+        explicit SceneFile(const std::string& path);
+
+        // Number of spheres
+        size_t size() const {
+            return m_count;
+        }
+
+        // Decodes spheres [first, first + count) into spheres[0, count) and materials[0, count)
+        void read(size_t first, size_t count, Sphere* spheres, Material* materials) const;
+        // Decodes the whole file, in parallel on pool
+        void read(ThreadPool& pool, std::vector<Sphere>& spheres, std::vector<Material>& materials) const;
+        // Creates one entity per sphere holding its Sphere and Material, returns the first.
+        // The entities get consecutive ids.
+        Entity load(ECS& ecs, ThreadPool& pool) const;
+
+        // Both throw std::runtime_error
+        static void write(const std::string& path, const std::vector<Sphere>& spheres, const std::vector<Material>& materials);
+        // Converts a text scene, one sphere per line:
+        //     sphere cx cy cz radius  r g b  metallic dielectric fuzz refraction_index  [dx dy dz]
+        // where r g b is the material's albedo and dx dy dz the sphere's motion over the
+        // ray time range. Blank lines and lines starting with # are skipped.
+        static void convert(const std::string& text_path, const std::string& path);
+
+    private:
+        template <typename Scalar>
+        void decode(size_t first, size_t count, Sphere* spheres, Material* materials) const;
+
+        MappedFile m_file;
+        size_t m_count = 0;
+        uint32_t m_scalar_size = 0;
+    };
+
+}
+#endif // SCENE_FILE_H
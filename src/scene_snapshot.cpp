@@ -0,0 +1,159 @@
+#include "scene_snapshot.h"
+#include <cassert>
+#include "geometry/hittable.h"
+
+namespace render {
+
+	SceneSnapshot SceneSnapshot::compile(const ECS& ecs) {
+		const auto view = ecs.view<Sphere, Material>();
+		std::vector<Sphere> spheres;
+		std::vector<Material> materials;
+		std::vector<Entity> entities;
+		spheres.reserve(view.size());
+		materials.reserve(view.size());
+		entities.reserve(view.size());
+		view.each([&](Entity entity, const Sphere& sphere, const Material& material) {
+			spheres.push_back(sphere);
+			materials.push_back(material);
+			entities.push_back(entity);
+			});
+		std::vector<TriangleMesh> meshes;
+		std::vector<Material> mesh_materials;
+		std::vector<Entity> mesh_entities;
+		if (ecs.isRegistered<TriangleMesh>()) {
+			ecs.forEach<TriangleMesh>([&](Entity entity, const TriangleMesh& mesh) {
+				if (ecs.hasComponent<Material>(entity)) {
+					meshes.push_back(mesh);
+					mesh_materials.push_back(ecs.getComponent<Material>(entity));
+					mesh_entities.push_back(entity);
+				}
+				});
+		}
+		SceneSnapshot scene = compile(std::move(spheres), std::move(materials), meshes, mesh_materials);
+		scene.entities = std::move(entities);
+		scene.mesh_entities = std::move(mesh_entities);
+		return scene;
+	}
+
+	SceneSnapshot SceneSnapshot::compile(std::vector<Sphere> spheres, std::vector<Material> materials,
+		const std::vector<TriangleMesh>& meshes, const std::vector<Material>& mesh_materials) {
+		assert(meshes.size() == mesh_materials.size() && "Every mesh needs a material.");
+		SceneSnapshot scene;
+		std::vector<AABB> start_bounds, end_bounds;
+		start_bounds.reserve(spheres.size());
+		end_bounds.reserve(spheres.size());
+		for (const Sphere& sphere : spheres) {
+			start_bounds.push_back(sphere.bounds_at(0.));
+			end_bounds.push_back(sphere.bounds_at(1.));
+		}
+		scene.materials = std::move(materials);
+
+		scene.bvh.build(start_bounds, end_bounds);
+
+		// Store the spheres in leaf order so each leaf tests a contiguous range
+		scene.spheres.reserve(spheres.size());
+		for (const uint32_t index : scene.bvh.primitive_indices()) {
+			scene.spheres.push_back(spheres[index], index);
+		}
+		scene.spheres.pad();
+
+		// Meshes share one vertex buffer, their triangles index it from the mesh's base
+		std::vector<IndexedTriangle> triangles;
+		for (size_t j = 0; j < meshes.size(); ++j) {
+			scene.mesh_buffers.push_back(meshes[j].buffers);
+			if (!meshes[j].buffers) {
+				continue;
+			}
+			const MeshBuffers& buffers = *meshes[j].buffers;
+			const uint32_t base = uint32_t(scene.triangles.vertices.size());
+			const uint32_t material = uint32_t(scene.materials.size());
+			scene.materials.push_back(mesh_materials[j]);
+			scene.triangles.vertices.insert(scene.triangles.vertices.end(), buffers.positions.begin(), buffers.positions.end());
+			for (size_t i = 0; i + 2 < buffers.indices.size(); i += 3) {
+				assert(buffers.indices[i] < buffers.positions.size() && buffers.indices[i + 1] < buffers.positions.size()
+					&& buffers.indices[i + 2] < buffers.positions.size() && "Mesh index past its last vertex.");
+				triangles.push_back(IndexedTriangle{ base + buffers.indices[i], base + buffers.indices[i + 1],
+					base + buffers.indices[i + 2], material });
+			}
+		}
+		scene.triangles.triangles = std::move(triangles);
+		std::vector<AABB> triangle_bounds;
+		triangle_bounds.reserve(scene.triangles.size());
+		for (size_t i = 0; i < scene.triangles.size(); ++i) {
+			triangle_bounds.push_back(scene.triangles.bounds(i));
+		}
+		scene.mesh_bvh.build(triangle_bounds);
+
+		// Same leaf ordering as the spheres
+		std::vector<IndexedTriangle> ordered;
+		ordered.reserve(scene.triangles.size());
+		for (const uint32_t index : scene.mesh_bvh.primitive_indices()) {
+			ordered.push_back(scene.triangles.triangles[index]);
+		}
+		scene.triangles.triangles = std::move(ordered);
+		return scene;
+	}
+
+	bool SceneSnapshot::refit(const ECS& ecs) {
+		const auto view = ecs.view<Sphere, Material>();
+		if (view.size() != entities.size()) {
+			return false;
+		}
+		std::vector<AABB> start_bounds, end_bounds;
+		std::vector<Sphere> moved;
+		std::vector<Material> new_materials;
+		start_bounds.reserve(view.size());
+		end_bounds.reserve(view.size());
+		moved.reserve(view.size());
+		new_materials.reserve(view.size());
+		bool same_entities = true;
+		view.each([&](Entity entity, const Sphere& sphere, const Material& material) {
+			same_entities = same_entities && entity == entities[moved.size()];
+			start_bounds.push_back(sphere.bounds_at(0.));
+			end_bounds.push_back(sphere.bounds_at(1.));
+			moved.push_back(sphere);
+			new_materials.push_back(material);
+			});
+		if (!same_entities) {
+			return false;
+		}
+
+		// Meshes keep their triangles, a refit only picks up new materials for them
+		std::vector<Material> mesh_materials;
+		size_t mesh_count = 0;
+		bool same_meshes = true;
+		if (ecs.isRegistered<TriangleMesh>()) {
+			ecs.forEach<TriangleMesh>([&](Entity entity, const TriangleMesh& mesh) {
+				if (!ecs.hasComponent<Material>(entity)) {
+					return;
+				}
+				const size_t j = mesh_count++;
+				same_meshes = same_meshes && j < mesh_entities.size() && entity == mesh_entities[j] && mesh.buffers == mesh_buffers[j];
+				if (mesh.buffers) {
+					mesh_materials.push_back(ecs.getComponent<Material>(entity));
+				}
+				});
+		}
+		if (!same_meshes || mesh_count != mesh_entities.size()) {
+			return false;
+		}
+		new_materials.insert(new_materials.end(), mesh_materials.begin(), mesh_materials.end());
+
+		// Static leaves skip the motion terms, a sphere that started moving in one needs
+		// a new compile
+		const std::vector<uint32_t>& order = bvh.primitive_indices();
+		for (size_t slot = bvh.static_first(); slot < order.size(); ++slot) {
+			if (moved[order[slot]].moving()) {
+				return false;
+			}
+		}
+
+		materials = std::move(new_materials);
+		bvh.refit(start_bounds, end_bounds);
+		for (size_t slot = 0; slot < order.size(); ++slot) {
+			spheres.set(slot, moved[order[slot]]);
+		}
+		return true;
+	}
+
+}
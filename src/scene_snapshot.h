@@ -0,0 +1,66 @@
+#ifndef SCENE_SNAPSHOT_H
+#define SCENE_SNAPSHOT_H
+
+#include <vector>
+#include "ecs/ECS.h"
+#include "geometry/bvh.h"
+#include "geometry/sphere_soa.h"
+#include "geometry/triangle_mesh.h"
+#include "material/material.h"
+
+namespace render {
+
+    // Read-only copy of everything a render needs, compiled from the ECS before the render
+    // starts. Render threads share it instead of the ECS, so the hot path does no sparse
+    // component lookups and never races with changes to the ECS.
+    // The BVH sees each sphere's bounds at both ends of the ray time range, see
+    // BVH::build. Leaves holding only static spheres sit at the end of the slot range,
+    // from bvh.static_first() on, and run the intersection kernel without the motion terms.
+    // Triangle meshes get a BVH of their own over one shared store. A hit slot below
+    // spheres.size() is a sphere slot, slot spheres.size() + i is triangle slot i.
+    struct SceneSnapshot {
+        BVH bvh;
+        // Spheres in BVH leaf order, each with its material index. The static leaves come
+        // last, so their kernel can only read past its range into static spheres or padding.
+        SphereSoA spheres;
+        BVH mesh_bvh;
+        TriangleStore triangles; // Triangles of every mesh in mesh_bvh leaf order
+        // Dense material table, the spheres' in view order then one per mesh
+        std::vector<Material> materials;
+        std::vector<Entity> entities; // Group entities in view order, a sphere's material index is a position here
+        std::vector<Entity> mesh_entities; // Entities holding a TriangleMesh, in storage order
+        std::vector<std::shared_ptr<const MeshBuffers>> mesh_buffers; // Their buffers when compiled
+
+        // Reads every entity of the ECS's Sphere + Material group, and every entity
+        // holding a TriangleMesh and a Material when that component is registered
+        static SceneSnapshot compile(const ECS& ecs);
+        // Compiles spheres[i] with materials[i], and meshes[j] with mesh_materials[j],
+        // straight from arrays, e.g. a loaded scene file, without going through an ECS.
+        // Such a snapshot has no entities to refit from.
+        static SceneSnapshot compile(std::vector<Sphere> spheres, std::vector<Material> materials,
+            const std::vector<TriangleMesh>& meshes = {}, const std::vector<Material>& mesh_materials = {});
+
+        // Updates the spheres and materials in place and refits the BVH. Meshes are static,
+        // only their materials are updated. Returns false, leaving the snapshot untouched,
+        // when entities joined or left the group, or a mesh was added, removed or given
+        // other buffers, since the snapshot was compiled; compile a new one then.
+        bool refit(const ECS& ecs);
+
+        bool is_triangle(int64_t slot) const {
+            return size_t(slot) >= spheres.size();
+        }
+        uint32_t triangle_slot(int64_t slot) const {
+            return uint32_t(size_t(slot) - spheres.size());
+        }
+        // Material index of whatever a hit slot names
+        uint32_t material_index(int64_t slot) const {
+            return is_triangle(slot) ? triangles.triangles[triangle_slot(slot)].material : spheres.material[slot];
+        }
+
+        const Material& material(uint32_t index) const {
+            return materials[index];
+        }
+    };
+
+}
+#endif // SCENE_SNAPSHOT_H
@@ -0,0 +1,257 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "common.h"
+
+// Thin wrappers over the widest vector unit enabled at build time, in double (vdouble)
+// and single (vfloat) precision. vreal follows the build's real type. Every kernel written
+// against these types also compiles to plain scalar code.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CPPRTW_SIMD_AVX
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CPPRTW_SIMD_SSE2
+#endif
+
+namespace render::simd {
+
+#if defined(CPPRTW_SIMD_AVX)
+
+    struct vmask {
+        __m256d v;
+    };
+
+    struct vdouble {
+        static constexpr int width = 4;
+        __m256d v;
+
+        static vdouble load(const double* p) { return { _mm256_loadu_pd(p) }; }
+        static vdouble broadcast(double x) { return { _mm256_set1_pd(x) }; }
+        static vdouble iota(double base) { return { _mm256_setr_pd(base, base + 1., base + 2., base + 3.) }; }
+        void store(double* p) const { _mm256_storeu_pd(p, v); }
+    };
+
+    inline vdouble operator+(vdouble a, vdouble b) { return { _mm256_add_pd(a.v, b.v) }; }
+    inline vdouble operator-(vdouble a, vdouble b) { return { _mm256_sub_pd(a.v, b.v) }; }
+    inline vdouble operator*(vdouble a, vdouble b) { return { _mm256_mul_pd(a.v, b.v) }; }
+    inline vdouble operator/(vdouble a, vdouble b) { return { _mm256_div_pd(a.v, b.v) }; }
+    inline vdouble sqrt(vdouble a) { return { _mm256_sqrt_pd(a.v) }; }
+    inline vdouble max(vdouble a, vdouble b) { return { _mm256_max_pd(a.v, b.v) }; }
+    inline vdouble min(vdouble a, vdouble b) { return { _mm256_min_pd(a.v, b.v) }; }
+    inline vmask operator<(vdouble a, vdouble b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+    inline vmask operator>(vdouble a, vdouble b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+    inline vmask operator>=(vdouble a, vdouble b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ) }; }
+    inline vmask operator<=(vdouble a, vdouble b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ) }; }
+    inline vmask operator&(vmask a, vmask b) { return { _mm256_and_pd(a.v, b.v) }; }
+    inline vmask operator|(vmask a, vmask b) { return { _mm256_or_pd(a.v, b.v) }; }
+    inline vdouble select(vmask m, vdouble a, vdouble b) { return { _mm256_blendv_pd(b.v, a.v, m.v) }; }
+    inline bool any(vmask m) { return _mm256_movemask_pd(m.v) != 0; }
+    inline int bits(vmask m) { return _mm256_movemask_pd(m.v); }
+
+    struct vmaskf {
+        __m256 v;
+    };
+
+    struct vfloat {
+        static constexpr int width = 8;
+        __m256 v;
+
+        static vfloat load(const float* p) { return { _mm256_loadu_ps(p) }; }
+        static vfloat broadcast(float x) { return { _mm256_set1_ps(x) }; }
+        // Lanes holding the bit patterns of slots first, first + 1, ...
+        static vfloat slots(uint32_t first) {
+            const int f = int(first);
+            return { _mm256_castsi256_ps(_mm256_setr_epi32(f, f + 1, f + 2, f + 3, f + 4, f + 5, f + 6, f + 7)) };
+        }
+        void store(float* p) const { _mm256_storeu_ps(p, v); }
+    };
+
+    inline vfloat operator+(vfloat a, vfloat b) { return { _mm256_add_ps(a.v, b.v) }; }
+    inline vfloat operator-(vfloat a, vfloat b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    inline vfloat operator*(vfloat a, vfloat b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    inline vfloat operator/(vfloat a, vfloat b) { return { _mm256_div_ps(a.v, b.v) }; }
+    inline vfloat sqrt(vfloat a) { return { _mm256_sqrt_ps(a.v) }; }
+    inline vfloat max(vfloat a, vfloat b) { return { _mm256_max_ps(a.v, b.v) }; }
+    inline vfloat min(vfloat a, vfloat b) { return { _mm256_min_ps(a.v, b.v) }; }
+    inline vmaskf operator<(vfloat a, vfloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline vmaskf operator>(vfloat a, vfloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline vmaskf operator>=(vfloat a, vfloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+    inline vmaskf operator<=(vfloat a, vfloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    inline vmaskf operator&(vmaskf a, vmaskf b) { return { _mm256_and_ps(a.v, b.v) }; }
+    inline vmaskf operator|(vmaskf a, vmaskf b) { return { _mm256_or_ps(a.v, b.v) }; }
+    inline vfloat select(vmaskf m, vfloat a, vfloat b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+    inline bool any(vmaskf m) { return _mm256_movemask_ps(m.v) != 0; }
+    inline int bits(vmaskf m) { return _mm256_movemask_ps(m.v); }
+
+#elif defined(CPPRTW_SIMD_SSE2)
+
+    struct vmask {
+        __m128d v;
+    };
+
+    struct vdouble {
+        static constexpr int width = 2;
+        __m128d v;
+
+        static vdouble load(const double* p) { return { _mm_loadu_pd(p) }; }
+        static vdouble broadcast(double x) { return { _mm_set1_pd(x) }; }
+        static vdouble iota(double base) { return { _mm_setr_pd(base, base + 1.) }; }
+        void store(double* p) const { _mm_storeu_pd(p, v); }
+    };
+
+    inline vdouble operator+(vdouble a, vdouble b) { return { _mm_add_pd(a.v, b.v) }; }
+    inline vdouble operator-(vdouble a, vdouble b) { return { _mm_sub_pd(a.v, b.v) }; }
+    inline vdouble operator*(vdouble a, vdouble b) { return { _mm_mul_pd(a.v, b.v) }; }
+    inline vdouble operator/(vdouble a, vdouble b) { return { _mm_div_pd(a.v, b.v) }; }
+    inline vdouble sqrt(vdouble a) { return { _mm_sqrt_pd(a.v) }; }
+    inline vdouble max(vdouble a, vdouble b) { return { _mm_max_pd(a.v, b.v) }; }
+    inline vdouble min(vdouble a, vdouble b) { return { _mm_min_pd(a.v, b.v) }; }
+    inline vmask operator<(vdouble a, vdouble b) { return { _mm_cmplt_pd(a.v, b.v) }; }
+    inline vmask operator>(vdouble a, vdouble b) { return { _mm_cmpgt_pd(a.v, b.v) }; }
+    inline vmask operator>=(vdouble a, vdouble b) { return { _mm_cmpge_pd(a.v, b.v) }; }
+    inline vmask operator<=(vdouble a, vdouble b) { return { _mm_cmple_pd(a.v, b.v) }; }
+    inline vmask operator&(vmask a, vmask b) { return { _mm_and_pd(a.v, b.v) }; }
+    inline vmask operator|(vmask a, vmask b) { return { _mm_or_pd(a.v, b.v) }; }
+    inline vdouble select(vmask m, vdouble a, vdouble b) {
+        return { _mm_or_pd(_mm_and_pd(m.v, a.v), _mm_andnot_pd(m.v, b.v)) };
+    }
+    inline bool any(vmask m) { return _mm_movemask_pd(m.v) != 0; }
+    inline int bits(vmask m) { return _mm_movemask_pd(m.v); }
+
+    struct vmaskf {
+        __m128 v;
+    };
+
+    struct vfloat {
+        static constexpr int width = 4;
+        __m128 v;
+
+        static vfloat load(const float* p) { return { _mm_loadu_ps(p) }; }
+        static vfloat broadcast(float x) { return { _mm_set1_ps(x) }; }
+        static vfloat slots(uint32_t first) {
+            const int f = int(first);
+            return { _mm_castsi128_ps(_mm_setr_epi32(f, f + 1, f + 2, f + 3)) };
+        }
+        void store(float* p) const { _mm_storeu_ps(p, v); }
+    };
+
+    inline vfloat operator+(vfloat a, vfloat b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline vfloat operator-(vfloat a, vfloat b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline vfloat operator*(vfloat a, vfloat b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline vfloat operator/(vfloat a, vfloat b) { return { _mm_div_ps(a.v, b.v) }; }
+    inline vfloat sqrt(vfloat a) { return { _mm_sqrt_ps(a.v) }; }
+    inline vfloat max(vfloat a, vfloat b) { return { _mm_max_ps(a.v, b.v) }; }
+    inline vfloat min(vfloat a, vfloat b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline vmaskf operator<(vfloat a, vfloat b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    inline vmaskf operator>(vfloat a, vfloat b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    inline vmaskf operator>=(vfloat a, vfloat b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+    inline vmaskf operator<=(vfloat a, vfloat b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    inline vmaskf operator&(vmaskf a, vmaskf b) { return { _mm_and_ps(a.v, b.v) }; }
+    inline vmaskf operator|(vmaskf a, vmaskf b) { return { _mm_or_ps(a.v, b.v) }; }
+    inline vfloat select(vmaskf m, vfloat a, vfloat b) {
+        return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) };
+    }
+    inline bool any(vmaskf m) { return _mm_movemask_ps(m.v) != 0; }
+    inline int bits(vmaskf m) { return _mm_movemask_ps(m.v); }
+
+#else
+
+    struct vmask {
+        bool v;
+    };
+
+    struct vdouble {
+        static constexpr int width = 1;
+        double v;
+
+        static vdouble load(const double* p) { return { *p }; }
+        static vdouble broadcast(double x) { return { x }; }
+        static vdouble iota(double base) { return { base }; }
+        void store(double* p) const { *p = v; }
+    };
+
+    inline vdouble operator+(vdouble a, vdouble b) { return { a.v + b.v }; }
+    inline vdouble operator-(vdouble a, vdouble b) { return { a.v - b.v }; }
+    inline vdouble operator*(vdouble a, vdouble b) { return { a.v * b.v }; }
+    inline vdouble operator/(vdouble a, vdouble b) { return { a.v / b.v }; }
+    inline vdouble sqrt(vdouble a) { return { std::sqrt(a.v) }; }
+    inline vdouble max(vdouble a, vdouble b) { return { a.v > b.v ? a.v : b.v }; }
+    inline vdouble min(vdouble a, vdouble b) { return { a.v < b.v ? a.v : b.v }; }
+    inline vmask operator<(vdouble a, vdouble b) { return { a.v < b.v }; }
+    inline vmask operator>(vdouble a, vdouble b) { return { a.v > b.v }; }
+    inline vmask operator>=(vdouble a, vdouble b) { return { a.v >= b.v }; }
+    inline vmask operator<=(vdouble a, vdouble b) { return { a.v <= b.v }; }
+    inline vmask operator&(vmask a, vmask b) { return { a.v && b.v }; }
+    inline vmask operator|(vmask a, vmask b) { return { a.v || b.v }; }
+    inline vdouble select(vmask m, vdouble a, vdouble b) { return m.v ? a : b; }
+    inline bool any(vmask m) { return m.v; }
+    inline int bits(vmask m) { return m.v ? 1 : 0; }
+
+    struct vmaskf {
+        bool v;
+    };
+
+    struct vfloat {
+        static constexpr int width = 1;
+        float v;
+
+        static vfloat load(const float* p) { return { *p }; }
+        static vfloat broadcast(float x) { return { x }; }
+        static vfloat slots(uint32_t first) {
+            float bits;
+            std::memcpy(&bits, &first, sizeof(bits));
+            return { bits };
+        }
+        void store(float* p) const { *p = v; }
+    };
+
+    inline vfloat operator+(vfloat a, vfloat b) { return { a.v + b.v }; }
+    inline vfloat operator-(vfloat a, vfloat b) { return { a.v - b.v }; }
+    inline vfloat operator*(vfloat a, vfloat b) { return { a.v * b.v }; }
+    inline vfloat operator/(vfloat a, vfloat b) { return { a.v / b.v }; }
+    inline vfloat sqrt(vfloat a) { return { std::sqrt(a.v) }; }
+    inline vfloat max(vfloat a, vfloat b) { return { a.v > b.v ? a.v : b.v }; }
+    inline vfloat min(vfloat a, vfloat b) { return { a.v < b.v ? a.v : b.v }; }
+    inline vmaskf operator<(vfloat a, vfloat b) { return { a.v < b.v }; }
+    inline vmaskf operator>(vfloat a, vfloat b) { return { a.v > b.v }; }
+    inline vmaskf operator>=(vfloat a, vfloat b) { return { a.v >= b.v }; }
+    inline vmaskf operator<=(vfloat a, vfloat b) { return { a.v <= b.v }; }
+    inline vmaskf operator&(vmaskf a, vmaskf b) { return { a.v && b.v }; }
+    inline vmaskf operator|(vmaskf a, vmaskf b) { return { a.v || b.v }; }
+    inline vfloat select(vmaskf m, vfloat a, vfloat b) { return m.v ? a : b; }
+    inline bool any(vmaskf m) { return m.v; }
+    inline int bits(vmaskf m) { return m.v ? 1 : 0; }
+
+#endif
+
+    // Slot bookkeeping for kernels that track which lane element won. Double lanes hold
+    // the slot as an exact integer value, float lanes hold its 32-bit pattern.
+    inline vdouble slots(vdouble, uint32_t first) { return vdouble::iota(double(first)); }
+    inline vdouble no_slot(vdouble) { return vdouble::broadcast(-1.); }
+    inline int64_t decode_slot(double lane) { return int64_t(lane); }
+
+    inline vfloat slots(vfloat, uint32_t first) { return vfloat::slots(first); }
+    inline vfloat no_slot(vfloat) {
+        const int32_t none = -1;
+        float bits;
+        std::memcpy(&bits, &none, sizeof(bits));
+        return vfloat::broadcast(bits);
+    }
+    inline int64_t decode_slot(float lane) {
+        int32_t slot;
+        std::memcpy(&slot, &lane, sizeof(slot));
+        return slot;
+    }
+
+#if defined(CPPRTW_PRECISION_FLOAT) || defined(CPPRTW_PRECISION_MIXED)
+    using vreal = vfloat;
+#else
+    using vreal = vdouble;
+#endif
+
+}
+#endif // SIMD_H
@@ -0,0 +1,125 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace {
+	// Pool and queue owned by the current thread, if it is a pool worker
+	thread_local const ThreadPool* t_pool = nullptr;
+	thread_local size_t t_queue = 0;
+}
+
+ThreadPool::ThreadPool(size_t thread_count) {
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (size_t i = 0; i < thread_count; ++i) {
+		m_queues.push_back(std::make_unique<WorkQueue>());
+	}
+	for (size_t i = 0; i + 1 < thread_count; ++i) {
+		m_threads.emplace_back(&ThreadPool::worker_loop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads) {
+		thread.join();
+	}
+}
+
+size_t ThreadPool::current_queue() const {
+	return t_pool == this ? t_queue : m_queues.size() - 1;
+}
+
+void ThreadPool::run(size_t count, void (*fn)(void*, size_t), void* context) {
+	if (count == 0) {
+		return;
+	}
+	Batch batch{ fn, context, count };
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending += count;
+	}
+
+	// Hand out contiguous ranges so neighbouring tasks start on the same thread
+	const size_t queue_count = m_queues.size();
+	for (size_t q = 0; q < queue_count; ++q) {
+		const size_t begin = count * q / queue_count;
+		const size_t end = count * (q + 1) / queue_count;
+		if (begin == end) {
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+		for (size_t index = begin; index < end; ++index) {
+			m_queues[q]->tasks.push_back(Task{ &batch, index });
+		}
+	}
+	m_wake.notify_all();
+
+	// Help until there is nothing left to take, then wait for the tasks still running
+	const size_t self = current_queue();
+	Task task;
+	while (batch.remaining.load(std::memory_order_acquire) > 0 && (pop(self, task) || steal(self, task))) {
+		execute(task);
+	}
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&] { return batch.remaining.load(std::memory_order_acquire) == 0; });
+}
+
+void ThreadPool::worker_loop(size_t self) {
+	t_pool = this;
+	t_queue = self;
+	Task task;
+	while (true) {
+		if (pop(self, task) || steal(self, task)) {
+			execute(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_wake.wait(lock, [&] { return m_stop || m_pending.load() > 0; });
+		if (m_stop) {
+			return;
+		}
+	}
+}
+
+bool ThreadPool::pop(size_t self, Task& task) {
+	WorkQueue& queue = *m_queues[self];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty()) {
+		return false;
+	}
+	task = queue.tasks.front();
+	queue.tasks.pop_front();
+	--m_pending;
+	return true;
+}
+
+bool ThreadPool::steal(size_t self, Task& task) {
+	const size_t queue_count = m_queues.size();
+	for (size_t offset = 1; offset < queue_count; ++offset) {
+		WorkQueue& queue = *m_queues[(self + offset) % queue_count];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) {
+			continue;
+		}
+		task = queue.tasks.back();
+		queue.tasks.pop_back();
+		--m_pending;
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::execute(const Task& task) {
+	Batch* batch = task.batch;
+	batch->fn(batch->context, task.index);
+	if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		// The batch may be destroyed as soon as its owner wakes, do not touch it past this point
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_done.notify_all();
+	}
+}
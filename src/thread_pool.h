@@ -0,0 +1,81 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Persistent pool with one task deque per thread. Owners take tasks from the front of
+// their own deque, idle threads steal from the back of the others. The thread calling
+// parallel_for runs tasks too, so a pool of size n starts n - 1 worker threads.
+class ThreadPool {
+public:
+    // thread_count = 0 uses every hardware thread
+    explicit ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that execute tasks, counting the caller
+    size_t size() const {
+        return m_queues.size();
+    }
+
+    // Index in [0, size()) of the calling thread. Threads outside the pool share the last
+    // index, so per-thread data indexed by it assumes one outside caller at a time.
+    size_t thread_index() const {
+        return current_queue();
+    }
+
+    // Calls task(index) for every index in [0, count) and returns once all have finished.
+    // Safe to call from inside a task.
+    template <typename F>
+    void parallel_for(size_t count, F&& task) {
+        using Fn = std::remove_reference_t<F>;
+        run(count, [](void* context, size_t index) {
+            (*static_cast<Fn*>(context))(index);
+            }, const_cast<void*>(static_cast<const void*>(&task)));
+    }
+
+    void run(size_t count, void (*fn)(void*, size_t), void* context);
+
+private:
+    struct Batch {
+        void (*fn)(void*, size_t);
+        void* context;
+        std::atomic<size_t> remaining;
+    };
+
+    struct Task {
+        Batch* batch;
+        size_t index;
+    };
+
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(size_t self);
+    bool pop(size_t self, Task& task);
+    bool steal(size_t self, Task& task);
+    void execute(const Task& task);
+    size_t current_queue() const;
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues; // The last queue is shared by outside threads
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::atomic<size_t> m_pending = 0; // Tasks queued but not yet taken
+    bool m_stop = false;
+};
+
+#endif // THREAD_POOL_H
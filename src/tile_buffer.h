@@ -0,0 +1,132 @@
+#ifndef TILE_BUFFER_H
+#define TILE_BUFFER_H
+
+#include <algorithm>
+#include <cmath>
+#include "aligned_allocator.h"
+#include "common.h"
+#include "geometry/interval.h"
+
+namespace render {
+
+    // Running mean and variance of the sample luminance of one pixel (Welford). count is
+    // also the pixel's sample count, and the index of its next sample.
+    struct PixelStats {
+        int count = 0;
+        double mean = 0.;
+        double m2 = 0.;
+
+        void add(double x) {
+            ++count;
+            const double delta = x - mean;
+            mean += delta / count;
+            m2 += delta * (x - mean);
+        }
+
+        // Dark pixels are judged against a floor so they are not sampled forever
+        bool converged(double threshold) const {
+            if (count < 2) {
+                return false;
+            }
+            const double standard_error = std::sqrt(m2 / (double(count) * (count - 1)));
+            return standard_error <= threshold * std::max(mean, 0.05);
+        }
+    };
+
+    // What a camera ray sees first, the features the auxiliary buffers average. A ray that
+    // escapes sees the background as its albedo, and no normal or depth.
+    struct FirstHit {
+        color albedo{ 0., 0., 0. };
+        vec3 normal{ 0., 0., 0. };
+        real depth = 0; // Distance from the ray origin
+    };
+
+    // Sample sums and statistics of the pixels of one tile, row-major within the tile.
+    // Each render thread reuses its own buffer, cache line aligned, so no two threads
+    // ever write the same line while accumulating.
+    struct alignas(64) TileBuffer {
+        int i0 = 0, j0 = 0;
+        int width = 0, height = 0;
+        aligned_vector<accum_color> colors;
+        aligned_vector<PixelStats> stats;
+        // Sums of the first-hit features of the samples, only kept when the render collects
+        // auxiliary buffers, see reset()
+        aligned_vector<accum_color> albedo;
+        aligned_vector<accum_color> normal;
+        aligned_vector<accum_real> depth;
+
+        // Covers [i0, i1) x [j0, j1) with no samples, reusing the storage. The feature sums
+        // are only sized with auxiliary, otherwise they stay empty.
+        void reset(int tile_i0, int tile_i1, int tile_j0, int tile_j1, bool auxiliary = false) {
+            i0 = tile_i0;
+            j0 = tile_j0;
+            width = tile_i1 - tile_i0;
+            height = tile_j1 - tile_j0;
+            const size_t pixels = size_t(width) * size_t(height);
+            colors.assign(pixels, accum_color(0., 0., 0.));
+            stats.assign(pixels, PixelStats{});
+            albedo.assign(auxiliary ? pixels : 0, accum_color(0., 0., 0.));
+            normal.assign(auxiliary ? pixels : 0, accum_color(0., 0., 0.));
+            depth.assign(auxiliary ? pixels : 0, accum_real(0.));
+        }
+
+        size_t size() const {
+            return colors.size();
+        }
+
+        bool has_auxiliary() const {
+            return !depth.empty();
+        }
+
+        void add_features(size_t k, const FirstHit& hit) {
+            albedo[k] += accum_color(hit.albedo);
+            normal[k] += accum_color(hit.normal);
+            depth[k] += accum_real(hit.depth);
+        }
+
+        size_t index(int x, int y) const {
+            return size_t(y - j0) * size_t(width) + size_t(x - i0);
+        }
+
+        // Mean of the pixel's samples, clamped to the displayable range; black without any
+        accum_color resolve(int x, int y) const {
+            const size_t k = index(x, y);
+            if (stats[k].count == 0) {
+                return accum_color(0., 0., 0.);
+            }
+            const accum_color mean = colors[k] / accum_real(stats[k].count);
+            const Interval intensity(0., 1.);
+            return accum_color(intensity.clamp(mean.x), intensity.clamp(mean.y), intensity.clamp(mean.z));
+        }
+
+        // Writes the resolved RGB row y of the tile to out, width * 3 floats
+        void resolve_row(int y, float* out) const {
+            for (int x = i0; x < i0 + width; ++x) {
+                const accum_color c = resolve(x, y);
+                *out++ = float(c.x);
+                *out++ = float(c.y);
+                *out++ = float(c.z);
+            }
+        }
+
+        // Writes the mean features of row y: width * 3 floats to out_albedo and out_normal,
+        // width to out_depth. Every sample of the pixels must have added its features.
+        void resolve_features_row(int y, float* out_albedo, float* out_normal, float* out_depth) const {
+            for (int x = i0; x < i0 + width; ++x) {
+                const size_t k = index(x, y);
+                const accum_real inv_count = stats[k].count > 0 ? accum_real(1) / accum_real(stats[k].count) : accum_real(0);
+                const accum_color a = albedo[k] * inv_count;
+                const accum_color n = normal[k] * inv_count;
+                *out_albedo++ = float(a.x);
+                *out_albedo++ = float(a.y);
+                *out_albedo++ = float(a.z);
+                *out_normal++ = float(n.x);
+                *out_normal++ = float(n.y);
+                *out_normal++ = float(n.z);
+                *out_depth++ = float(depth[k] * inv_count);
+            }
+        }
+    };
+
+}
+#endif // TILE_BUFFER_H